@@ -0,0 +1,117 @@
+#ifndef _BATCH_HPP
+#define _BATCH_HPP
+// Ensemble batch mode
+// Production runs often measure many small, independent configurations at once.
+// This mode allocates K lattices and runs C = A*B, k_mat_nn(), on each of them
+// with two schedules:
+//   sequential - one lattice after another, each with all of the threads
+//   concurrent - the threads are split into min(K, threads) groups, each group
+//                working through its share of the lattices with a nested team
+// For each schedule it reports the aggregate throughput over the whole batch and
+// the distribution of the per-lattice, per-iteration latency.  The warmups of
+// every lattice run before the timed region, which holds only the kernels.
+// Thread placement of the nested teams follows OMP_PLACES and OMP_PROC_BIND,
+// for example OMP_PLACES=cores OMP_PROC_BIND=spread,close.
+#include <algorithm>
+#include <omp.h>
+
+// Runs fn(k) for every lattice k, with lattice k owned by group k % groups
+// and each group running a nested team of threads_per_group threads
+template <class Fn>
+static void for_each_lattice(size_t batch, int groups, int threads_per_group, Fn fn)
+{
+  #pragma omp parallel num_threads(groups)
+  {
+    omp_set_num_threads(threads_per_group);
+    const int g = omp_get_thread_num();
+    for (size_t k = g; k < batch; k += groups)
+      fn(k);
+  }
+}
+
+int run_batch(const size_t dims[4], size_t batch, size_t iterations)
+{
+  if (batch == 0 || iterations == 0) {
+    fprintf(stderr, "ERROR: Batch mode requires at least one lattice and one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  const int threads = omp_get_max_threads();
+  const int groups = (int)std::min<size_t>(batch, threads);
+  const int group_threads = std::max(threads / groups, 1);
+  omp_set_max_active_levels(2);
+
+  // each lattice is first touched by the group that owns it in the concurrent schedule
+  std::vector<std::vector<site>> a(batch), c(batch);
+  std::vector<su3_matrix> b(4);
+  for (size_t k = 0; k < batch; ++k) {
+    a[k].resize(total_sites);
+    c[k].resize(total_sites);
+  }
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+  for_each_lattice(batch, groups, group_threads, [&](size_t k) {
+    std::vector<su3_matrix> bk(4);
+    first_touch(a[k].data(), bk.data(), c[k].data(), total_sites);
+    make_lattice(a[k].data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  });
+
+  if (verbose >= 1) {
+    printf("Batch of %zu lattices of %zux%zux%zux%zu sites\n", batch, dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups per lattice\n", iterations, warmups);
+    printf("Concurrent schedule uses %d groups of %d threads\n", groups, group_threads);
+    printf("%12s %12s %12s %12s %12s %12s\n", "schedule", "GFLOP/s", "GByte/s",
+           "min_us", "mean_us", "max_us");
+  }
+
+  const double flops = (double)batch * total_sites * 864.0 * iterations;
+  const double bytes = (double)batch * (2.0 * sizeof(site) * total_sites + 4.0 * sizeof(su3_matrix)) * iterations;
+  // n calls on lattice k, returning the time per call
+  auto run = [&](size_t k, size_t n, bool timed) {
+    auto t0 = Clock::now();
+    for (size_t iters = 0; iters < n; ++iters) {
+      TRACE_ZONE(timed ? "iteration" : "warmup");
+      k_mat_nn(a[k].data(), b.data(), site_links{c[k].data()}, total_sites);
+    }
+    return std::chrono::duration<double>(Clock::now()-t0).count() / std::max<size_t>(n, 1);
+  };
+
+  bool result = true;
+  for (int concurrent = 0; concurrent <= 1; ++concurrent) {
+    std::vector<double> latency(batch);
+    double twall;
+    if (concurrent) {
+      for_each_lattice(batch, groups, group_threads, [&](size_t k) { run(k, warmups, false); });
+      auto tstart = Clock::now();
+      for_each_lattice(batch, groups, group_threads, [&](size_t k) { latency[k] = run(k, iterations, true); });
+      twall = std::chrono::duration<double>(Clock::now()-tstart).count();
+    } else {
+      for (size_t k = 0; k < batch; ++k)
+        run(k, warmups, false);
+      auto tstart = Clock::now();
+      for (size_t k = 0; k < batch; ++k)
+        latency[k] = run(k, iterations, true);
+      twall = std::chrono::duration<double>(Clock::now()-tstart).count();
+    }
+
+    for (size_t k = 0; k < batch; ++k)
+      result = result && verify_mat_nn(a[k], b, c[k], total_sites);
+
+    double mean = 0.0;
+    for (double t : latency)
+      mean += t;
+    mean /= batch;
+    printf("%12s %12.3f %12.3f %12.2f %12.2f %12.2f\n", concurrent ? "concurrent" : "sequential",
+           flops / twall / 1.0e9, bytes / twall / 1.0e9,
+           *std::min_element(latency.begin(), latency.end()) * 1.0e6, mean * 1.0e6,
+           *std::max_element(latency.begin(), latency.end()) * 1.0e6);
+  }
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _BATCH_HPP
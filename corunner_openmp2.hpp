@@ -0,0 +1,213 @@
+#ifndef _CORUNNER_OPENMP2_HPP
+#define _CORUNNER_OPENMP2_HPP
+// Co-runner mode
+// Measures how C = A*B degrades when a noisy neighbour shares the node.  The
+// last -H cores of the affinity mask run a load generator on pinned threads,
+// and the OpenMP threads of the kernel are pinned to the remaining cores.  The
+// loads, selected with -P, are
+//   stream  a triad over private arrays far larger than the caches, saturating
+//           the memory bandwidth
+//   thrash  random read-modify-writes of cache lines over twice the last level
+//           cache, evicting the lattices of the kernel
+// The intensity is the duty cycle of the load: in every CORUNNER_PERIOD it
+// works for the given percentage and sleeps for the rest.  Without an
+// intensity in -H the mode steps through 0, 25, 50, 75 and 100%, and reports
+// the kernel throughput against the intensity, relative to the kernel alone,
+// together with the bandwidth the load achieved.  The curve is also written to
+// the -c csv file.
+//   -H cores[,intensity]  -P stream|thrash|all
+#include <atomic>
+#include <thread>
+#include <sched.h>
+#include <pthread.h>
+#include <omp.h>
+#include "sweep.hpp"
+
+#ifndef CORUNNER_STREAM_BYTES
+#  define CORUNNER_STREAM_BYTES (64L*1024*1024)  // per array of a load thread
+#endif
+#ifndef CORUNNER_PERIOD
+#  define CORUNNER_PERIOD 1000  // microseconds of a duty cycle
+#endif
+
+enum CorunnerLoad { CORUNNER_STREAM, CORUNNER_THRASH };
+static const char *corunner_names[] = {"stream", "thrash"};
+
+struct CorunnerState {
+  std::atomic<bool> running;
+  std::atomic<int> ready;    // load threads with their arrays in place
+  std::vector<double> rate;  // bytes per second of every load thread
+};
+
+static void pin_thread(pthread_t thread, int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// one load thread, working for intensity percent of every period
+static void corunner_load(CorunnerLoad load, int intensity, size_t bytes, size_t k, CorunnerState *state)
+{
+  const size_t n = bytes / sizeof(double);
+  std::vector<double> x(n, 1.0), y(load == CORUNNER_STREAM ? n : 0, 2.0), z(y.size(), 0.0);
+  const auto period = std::chrono::microseconds(CORUNNER_PERIOD);
+  const auto work = period * intensity / 100;
+  uint64_t moved = 0, rng = 0x9E3779B97F4A7C15ULL * (k + 1);
+  size_t i = 0;
+  ++state->ready;
+  const auto tstart = Clock::now();
+  while (state->running.load(std::memory_order_relaxed)) {
+    const auto start = Clock::now();
+    do {
+      // 4096 elements or lines between clock reads
+      if (load == CORUNNER_STREAM) {
+        for (size_t e = 0; e < 4096; ++e, i = i + 1 < n ? i + 1 : 0)
+          z[i] = x[i] + 0.5 * y[i];
+        moved += 4096 * 3 * sizeof(double);
+      } else {
+        for (size_t e = 0; e < 4096; ++e) {
+          rng ^= rng << 13;
+          rng ^= rng >> 7;
+          rng ^= rng << 17;
+          x[(rng % (n / 8)) * 8] += 1.0;
+        }
+        moved += 4096 * 2 * 64;
+      }
+    } while (Clock::now() - start < work);
+    if (intensity < 100)
+      std::this_thread::sleep_until(start + period);
+  }
+  state->rate[k] = moved / std::chrono::duration<double>(Clock::now()-tstart).count();
+}
+
+int run_corunner(const size_t dims[4], size_t iterations, const std::string &spec,
+                 const std::string &pattern, const std::string &csv_filename)
+{
+  int cores = 1, intensity = -1;
+  if (sscanf(spec.c_str(), "%d,%d", &cores, &intensity) < 1 || cores < 1 || intensity > 100) {
+    fprintf(stderr, "ERROR: The co-runner is given as -H cores[,intensity], intensity 0 to 100\n");
+    return EXIT_FAILURE;
+  }
+  std::vector<CorunnerLoad> loads;
+  for (int g = CORUNNER_STREAM; g <= CORUNNER_THRASH; ++g)
+    if (pattern == "all" || pattern == corunner_names[g])
+      loads.push_back((CorunnerLoad)g);
+  if (loads.empty()) {
+    fprintf(stderr, "ERROR: Unknown load %s (stream|thrash|all)\n", pattern.c_str());
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Co-runner mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+  std::vector<int> intensities = {0, 25, 50, 75, 100};
+  if (intensity >= 0)
+    intensities = {0, intensity};
+
+  // the load takes the last cores of the mask, the kernel the others
+  cpu_set_t mask;
+  std::vector<int> cpus;
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &mask))
+        cpus.push_back(cpu);
+  std::vector<int> load_cpus, kernel_cpus;
+  for (size_t k = 0; k < cpus.size(); ++k)
+    (k + cores < cpus.size() ? kernel_cpus : load_cpus).push_back(cpus[k]);
+  const bool shared = kernel_cpus.empty();
+  if (shared) {
+    kernel_cpus = cpus;
+    fprintf(stderr, "WARNING: %zu cores available, the co-runner shares the cores of the kernel\n", cpus.size());
+  }
+  const int threads = std::min<int>(omp_get_max_threads(), kernel_cpus.size());
+  omp_set_num_threads(threads);
+  #pragma omp parallel
+  pin_thread(pthread_self(), kernel_cpus[omp_get_thread_num() % kernel_cpus.size()]);
+
+  long cache[3];
+  cache_sizes(cache);
+  const long llc = std::max(std::max(cache[0], cache[1]), cache[2]) > 0
+                 ? std::max(std::max(cache[0], cache[1]), cache[2]) : 64L*1024*1024;
+  const size_t thrash_bytes = std::max<size_t>(2 * llc / cores, 64 * 4096);
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<site> c(total_sites);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, threads);
+    printf("Kernel on cpus %d-%d, %d load threads on cpus %d-%d\n", kernel_cpus.front(), kernel_cpus.back(),
+           cores, shared ? cpus.front() : load_cpus.front(), shared ? cpus.back() : load_cpus.back());
+  }
+  FILE *output = NULL;
+  if (csv_filename != "") {
+    output = fopen(csv_filename.c_str(), "w");
+    fprintf(output, "load,intensity,kernel_gflops,kernel_gbytes,relative,load_gbytes\n");
+  }
+  printf("%8s %10s %12s %12s %10s %12s\n", "load", "intensity", "GFLOP/s", "GByte/s", "relative", "load_GB/s");
+
+  const double flops = 864.0 * total_sites;
+  const double bytes = 2.0 * sizeof(site) * total_sites + 4 * sizeof(su3_matrix);
+  double alone = 0.0;
+  bool result = true;
+  for (CorunnerLoad load : loads)
+    for (int level : intensities) {
+      CorunnerState state;
+      state.running = true;
+      state.ready = 0;
+      state.rate.assign(cores, 0.0);
+      std::vector<std::thread> workers;
+      if (level > 0)
+        for (int k = 0; k < cores; ++k) {
+          workers.emplace_back(corunner_load, load, level, load == CORUNNER_STREAM ? CORUNNER_STREAM_BYTES
+                               : thrash_bytes, k, &state);
+          pin_thread(workers.back().native_handle(), shared ? cpus[k % cpus.size()] : load_cpus[k]);
+        }
+
+      // the load runs from before the warmups to after the timed iterations,
+      // its arrays are allocated and touched before
+      while (state.ready < (int)workers.size())
+        std::this_thread::yield();
+      auto tstart = Clock::now();
+      for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+        if (iters == warmups)
+          tstart = Clock::now();
+        TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+        k_mat_nn(a.data(), b.data(), site_links{c.data()}, total_sites);
+      }
+      const double ttotal = std::chrono::duration<double>(Clock::now()-tstart).count();
+      state.running = false;
+      for (std::thread &w : workers)
+        w.join();
+      result = verify_mat_nn(a, b, c, total_sites) && result;
+
+      const double gflops = iterations * flops / ttotal / 1.0e9;
+      if (level == 0 && alone == 0.0)
+        alone = gflops;
+      double load_gbytes = 0.0;
+      for (double r : state.rate)
+        load_gbytes += r / 1.0e9;
+      printf("%8s %9d%% %12.3f %12.3f %10.3f %12.3f\n", corunner_names[load], level, gflops,
+             iterations * bytes / ttotal / 1.0e9, gflops / alone, load_gbytes);
+      if (output != NULL)
+        fprintf(output, "%s,%d,%f,%f,%f,%f\n", corunner_names[load], level, gflops,
+                iterations * bytes / ttotal / 1.0e9, gflops / alone, load_gbytes);
+    }
+  if (output != NULL)
+    fclose(output);
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _CORUNNER_OPENMP2_HPP
@@ -0,0 +1,199 @@
+#ifndef _DIRTY_OPENMP2_HPP
+#define _DIRTY_OPENMP2_HPP
+// Dirty block mode
+// Local update algorithms change only some links between measurements.  Every
+// iteration here changes a fraction -f of the sites of A, either as one
+// contiguous run or scattered at random (-P contig|scattered|all), and marks the
+// blocks of -z sites holding them in a bitmap.  C = A*B is then recomputed only
+// for the dirty blocks, found by scanning the bitmap, and the bitmap is cleared.
+// The time of the recomputation and of the bookkeeping (marking, scanning and
+// clearing) are compared with a full recomputation of every site.  Without -f
+// and -z the mode steps through a range of fractions and block sizes, and the
+// table is also written to the -c csv file.
+//   -f fraction  -z block size  -P contig|scattered|all
+#include <cstdint>
+#include <random>
+#include <algorithm>
+#include <omp.h>
+
+#ifndef DIRTY_SEED
+#  define DIRTY_SEED 4242
+#endif
+
+// the count changed sites of an iteration, untimed as they are the application's
+// choice; the scattered sites are drawn with repeats, which are removed so no
+// site is updated by two threads
+static void changed_sites(bool scattered, size_t iter, size_t count, size_t total_sites,
+                          std::vector<size_t> &changed)
+{
+  changed.resize(count);
+  if (scattered) {
+    std::mt19937_64 gen(DIRTY_SEED + iter);
+    for (size_t &i : changed)
+      i = gen() % total_sites;
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+  } else {
+    const size_t start = (iter * changed.size()) % total_sites;
+    for (size_t k = 0; k < changed.size(); ++k)
+      changed[k] = (start + k) % total_sites;
+  }
+}
+
+// the changed sites get new link values
+static void update_sites(site *a, const std::vector<size_t> &changed, size_t iter)
+{
+  #pragma omp parallel for
+  for (size_t k = 0; k < changed.size(); ++k)
+    a[changed[k]].link[k % 4].e[0][0] = Complx{(Real)(1 + iter % 3), 0.0};
+}
+
+// sets the bits of the blocks holding the changed sites
+static void mark_dirty(const std::vector<size_t> &changed, size_t block, uint64_t *bitmap)
+{
+  #pragma omp parallel for
+  for (size_t k = 0; k < changed.size(); ++k) {
+    const size_t blk = changed[k] / block;
+    #pragma omp atomic
+    bitmap[blk / 64] |= (uint64_t)1 << (blk % 64);
+  }
+}
+
+// lists the dirty blocks in order and clears the bitmap
+static size_t scan_dirty(uint64_t *bitmap, size_t words, size_t *list)
+{
+  size_t n = 0;
+  for (size_t w = 0; w < words; ++w) {
+    uint64_t bits = bitmap[w];
+    while (bits != 0) {
+      list[n++] = w * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+    bitmap[w] = 0;
+  }
+  return n;
+}
+
+// C = A*B for the sites of the listed blocks
+static void k_mat_nn_blocks(const site *a, const su3_matrix *b, site *c, const size_t *list, size_t n,
+                            size_t block, size_t total_sites)
+{
+  #pragma omp parallel for schedule(static)
+  for (size_t k = 0; k < n; ++k) {
+    const size_t end = std::min(total_sites, (list[k] + 1) * block);
+    for (size_t i = list[k] * block; i < end; ++i)
+      mult_su3_site(&a[i], b, c[i].link);
+  }
+}
+
+int run_dirty(const size_t dims[4], size_t iterations, double fraction, size_t block,
+              const std::string &pattern, const std::string &csv_filename)
+{
+  if (pattern != "all" && pattern != "contig" && pattern != "scattered") {
+    fprintf(stderr, "ERROR: Unknown pattern %s (contig|scattered|all)\n", pattern.c_str());
+    return EXIT_FAILURE;
+  }
+  if (fraction > 1.0) {
+    fprintf(stderr, "ERROR: The dirty fraction must be at most 1\n");
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Dirty mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+  std::vector<double> fractions = {0.001, 0.01, 0.05, 0.1, 0.25, 0.5, 1.0};
+  std::vector<size_t> blocks = {16, 64, 256, 1024, 4096};
+  if (fraction > 0.0)
+    fractions = {fraction};
+  if (block > 0)
+    blocks = {block};
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<site> c(total_sites);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+
+  // the full recomputation of every site, the reference for the speedup
+  auto tstart = Clock::now();
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    k_mat_nn(a.data(), b.data(), site_links{c.data()}, total_sites);
+  }
+  const double tfull = std::chrono::duration<double>(Clock::now()-tstart).count() / iterations;
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+    printf("Full recomputation = %.3f ms per iteration\n", tfull * 1.0e3);
+  }
+  FILE *output = NULL;
+  if (csv_filename != "") {
+    output = fopen(csv_filename.c_str(), "w");
+    fprintf(output, "pattern,fraction,block,dirty_blocks,kernel_ms,bookkeeping_ms,full_ms,speedup\n");
+  }
+  printf("%10s %9s %7s %12s %11s %13s %10s %9s\n", "pattern", "fraction", "block", "dirty_blocks",
+         "kernel_ms", "bookkeep_ms", "GByte/s", "speedup");
+
+  bool result = true;
+  for (int scattered = 0; scattered < 2; ++scattered) {
+    if (pattern != "all" && (pattern == "scattered") != (scattered == 1))
+      continue;
+    const char *name = scattered ? "scattered" : "contig";
+    for (double f : fractions)
+      for (size_t bs : blocks) {
+        const size_t nblocks = (total_sites + bs - 1) / bs;
+        std::vector<uint64_t> bitmap((nblocks + 63) / 64, 0);
+        std::vector<size_t> list(nblocks);
+        const size_t count = std::max<size_t>(1, (size_t)(f * total_sites));
+        std::vector<size_t> changed(count);
+
+        double tkernel = 0.0, tbook = 0.0;
+        size_t dirty = 0;
+        for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+          changed_sites(scattered, iters, count, total_sites, changed);
+          update_sites(a.data(), changed, iters);
+          TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+          auto t0 = Clock::now();
+          mark_dirty(changed, bs, bitmap.data());
+          const size_t n = scan_dirty(bitmap.data(), bitmap.size(), list.data());
+          auto t1 = Clock::now();
+          k_mat_nn_blocks(a.data(), b.data(), c.data(), list.data(), n, bs, total_sites);
+          auto t2 = Clock::now();
+          if (iters >= warmups) {
+            tbook += std::chrono::duration<double>(t1-t0).count();
+            tkernel += std::chrono::duration<double>(t2-t1).count();
+            dirty += n;
+          }
+        }
+        // C must be up to date everywhere, a missed block leaves stale sites
+        result = result && verify_mat_nn(a, b, c, total_sites);
+
+        tkernel /= iterations;
+        tbook /= iterations;
+        const double dirty_blocks = (double)dirty / iterations;
+        // the bytes of the recomputed sites
+        const double bytes = std::min<double>(dirty_blocks * bs, total_sites) * 2.0 * sizeof(site);
+        const double speedup = tfull / (tkernel + tbook);
+        printf("%10s %9.4f %7zu %12.1f %11.4f %13.4f %10.3f %9.2f\n", name, f, bs, dirty_blocks,
+               tkernel * 1.0e3, tbook * 1.0e3, bytes / tkernel / 1.0e9, speedup);
+        if (output != NULL)
+          fprintf(output, "%s,%f,%zu,%f,%f,%f,%f,%f\n", name, f, bs, dirty_blocks,
+                  tkernel * 1.0e3, tbook * 1.0e3, tfull * 1.0e3, speedup);
+      }
+  }
+  if (output != NULL)
+    fclose(output);
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _DIRTY_OPENMP2_HPP
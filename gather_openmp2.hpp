@@ -0,0 +1,190 @@
+#ifndef _GATHER_OPENMP2_HPP
+#define _GATHER_OPENMP2_HPP
+// Gather pattern mode
+// Runs C = A*B with A read through a precomputed index table,
+//   c[i] = a[perm[i]] * b
+// as stencil codes read their neighbours through gather tables.  The patterns,
+// selected with -P, are
+//   contig  the identity, the streaming baseline
+//   shift   nearest neighbour shifts +x,-x,...,+t,-t with periodic boundaries
+//   stride  i*s mod V, s the first stride from GATHER_STRIDE coprime with V
+//   block   blocks of GATHER_BLOCK sites in random order, in order within a block
+//   random  a random permutation of the sites
+// With -D d > 0 every pattern is run again with a software prefetch of
+// a[perm[i+d]], and the gain over the plain gather is reported.
+//   -P contig|shift|stride|block|random|all  -D prefetch distance
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <omp.h>
+
+#ifndef GATHER_STRIDE
+#  define GATHER_STRIDE 33  // sites
+#endif
+#ifndef GATHER_BLOCK
+#  define GATHER_BLOCK 64  // sites
+#endif
+#ifndef GATHER_SEED
+#  define GATHER_SEED 12345
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define PREFETCH(p) __builtin_prefetch(p)
+#else
+#  define PREFETCH(p)
+#endif
+
+struct GatherPattern {
+  std::string name;
+  std::vector<size_t> perm;
+};
+
+// the patterns selected by spec, in the order of the table above
+static std::vector<GatherPattern> make_patterns(const std::string &spec, const site *a, const size_t dims[4])
+{
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  const bool all = spec == "all";
+  std::vector<GatherPattern> patterns;
+  std::vector<size_t> perm(total_sites);
+
+  if (all || spec == "contig") {
+    std::iota(perm.begin(), perm.end(), 0);
+    patterns.push_back({"contig", perm});
+  }
+  if (all || spec == "shift") {
+    const char *names[] = {"+x", "-x", "+y", "-y", "+z", "-z", "+t", "-t"};
+    for (int dir = 0; dir < 4; ++dir)
+      for (int sign = 1; sign >= -1; sign -= 2) {
+        #pragma omp parallel for
+        for (size_t i = 0; i < total_sites; ++i)
+          perm[i] = neighbor(a[i], dir, sign, dims);
+        patterns.push_back({std::string("shift") + names[2*dir + (sign < 0)], perm});
+      }
+  }
+  if (all || spec == "stride") {
+    size_t s = GATHER_STRIDE;
+    while (std::gcd(s, total_sites) != 1)
+      ++s;
+    for (size_t i = 0; i < total_sites; ++i)
+      perm[i] = (i * s) % total_sites;
+    patterns.push_back({"stride" + std::to_string(s), perm});
+  }
+  std::mt19937_64 gen(GATHER_SEED);
+  if (all || spec == "block") {
+    std::vector<size_t> blocks((total_sites + GATHER_BLOCK - 1) / GATHER_BLOCK);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::shuffle(blocks.begin(), blocks.end(), gen);
+    size_t i = 0;
+    for (size_t blk : blocks)
+      for (size_t j = blk * GATHER_BLOCK; j < std::min(total_sites, (blk + 1) * GATHER_BLOCK); ++j)
+        perm[i++] = j;
+    patterns.push_back({"block" + std::to_string(GATHER_BLOCK), perm});
+  }
+  if (all || spec == "random") {
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), gen);
+    patterns.push_back({"random", perm});
+  }
+  return patterns;
+}
+
+// c[i] = a[perm[i]] * b, prefetching the site distance sites ahead when distance > 0
+static void k_mat_nn_gather(const site *a, const size_t *perm, const su3_matrix *b, site *c,
+                            size_t total_sites, size_t distance)
+{
+  if (distance == 0) {
+    #pragma omp parallel for
+    for (size_t i = 0; i < total_sites; ++i)
+      mult_su3_site(&a[perm[i]], b, c[i].link);
+  } else {
+    #pragma omp parallel for
+    for (size_t i = 0; i < total_sites; ++i) {
+      if (i + distance < total_sites) {
+        const char *p = (const char *)&a[perm[i + distance]];
+        for (size_t line = 0; line < sizeof(site); line += 64)
+          PREFETCH(p + line);
+      }
+      mult_su3_site(&a[perm[i]], b, c[i].link);
+    }
+  }
+}
+
+static double time_gather(const site *a, const size_t *perm, const su3_matrix *b, site *c,
+                          size_t total_sites, size_t iterations, size_t distance)
+{
+  auto tstart = Clock::now();
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    k_mat_nn_gather(a, perm, b, c, total_sites, distance);
+  }
+  return std::chrono::duration<double>(Clock::now()-tstart).count();
+}
+
+// the sites of a seen through the index table, for verify_links()
+struct gathered_sites {
+  const site *a;
+  const size_t *perm;
+  const site &operator[](size_t i) const { return a[perm[i]]; }
+};
+
+int run_gather(const size_t dims[4], size_t iterations, const std::string &spec, size_t distance)
+{
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<site> c(total_sites);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  // links that differ from site to site, so a wrong index in perm shows up
+  make_check_links(a.data(), b.data(), total_sites);
+
+  const std::vector<GatherPattern> patterns = make_patterns(spec, a.data(), dims);
+  if (patterns.empty()) {
+    fprintf(stderr, "ERROR: Unknown pattern %s (contig|shift|stride|block|random|all)\n", spec.c_str());
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Gather mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+    if (distance > 0)
+      printf("Prefetch distance = %zu sites\n", distance);
+  }
+  if (distance > 0)
+    printf("%12s %12s %12s %12s %12s\n", "pattern", "GFLOP/s", "GByte/s", "prefetch", "gain");
+  else
+    printf("%12s %12s %12s\n", "pattern", "GFLOP/s", "GByte/s");
+
+  // each site reads its index, a site of A and writes a site of C
+  const double bytes = (2.0 * sizeof(site) + sizeof(size_t)) * total_sites;
+  const double flops = 864.0 * total_sites;
+  bool result = true;
+  for (const GatherPattern &p : patterns) {
+    const double ttotal = time_gather(a.data(), p.perm.data(), b.data(), c.data(), total_sites, iterations, 0);
+    result = result && verify_links(gathered_sites{a.data(), p.perm.data()}, b,
+                                    [&](size_t i) { return c[i].link; }, total_sites);
+    printf("%12s %12.3f %12.3f", p.name.c_str(), iterations * flops / ttotal / 1.0e9,
+           iterations * bytes / ttotal / 1.0e9);
+    if (distance > 0) {
+      const double tprefetch = time_gather(a.data(), p.perm.data(), b.data(), c.data(), total_sites, iterations, distance);
+      result = result && verify_links(gathered_sites{a.data(), p.perm.data()}, b,
+                                      [&](size_t i) { return c[i].link; }, total_sites);
+      printf(" %12.3f %12.3f", iterations * bytes / tprefetch / 1.0e9, ttotal / tprefetch);
+    }
+    printf("\n");
+  }
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _GATHER_OPENMP2_HPP
@@ -0,0 +1,92 @@
+#ifndef _GAUGE_OPENMP2_HPP
+#define _GAUGE_OPENMP2_HPP
+// Gauge field helpers shared by the smearing and update modes
+//   SiteRng        - an independent random number stream per site
+//   make_gauge     - a lattice of SU(3) links near the identity
+//   site_staple    - the sum of the six staples around a link
+//   max_unitarity_deviation - the worst link of a lattice
+#include <cstdint>
+#include <omp.h>
+
+#ifndef GAUGE_SEED
+#  define GAUGE_SEED 20240917
+#endif
+
+// splitmix64, seeded from the seed and the site index so every site has its
+// own stream and the field does not depend on the number of threads
+struct SiteRng {
+  uint64_t state;
+  SiteRng() {}
+  SiteRng(uint64_t seed, size_t i) : state(seed ^ (0x9E3779B97F4A7C15ULL * (i + 1))) { next(); }
+  uint64_t next() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  // uniform in [0,1)
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+// builds the lattice with links 1 + eps*R, R uniform in [-1,1) per element,
+// projected onto SU(3); eps = 0 gives a cold start with every link the identity
+static void make_gauge(site *a, const size_t dims[4], double eps)
+{
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  make_lattice(a, dims[0], dims[1], dims[2], dims[3], Complx{0.0,0.0});
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i) {
+    SiteRng rng(GAUGE_SEED, i);
+    for (int j = 0; j < 4; ++j) {
+      su3_matrix &u = a[i].link[j];
+      for (int k = 0; k < 3; ++k)
+        for (int l = 0; l < 3; ++l) {
+          const Real re = (k == l ? 1.0 : 0.0) + eps * (2 * rng.uniform() - 1);
+          const Real im = eps * (2 * rng.uniform() - 1);
+          u.e[k][l] = Complx{re, im};
+        }
+      reunit_su3(&u);
+    }
+  }
+}
+
+// sum of the six staples of link mu at site i, oriented like U_mu(x)
+//   sum_nu!=mu  U_nu(x) U_mu(x+nu) U_nu^+(x+mu) + U_nu^+(x-nu) U_mu(x-nu) U_nu(x-nu+mu)
+static inline void site_staple(const site *a, size_t i, int mu, const size_t dims[4], su3_matrix *stp)
+{
+  const site &xmu = a[neighbor(a[i], mu, 1, dims)];
+  su3_matrix tmp1, tmp2;
+  for (int k = 0; k < 3; ++k)
+    for (int l = 0; l < 3; ++l)
+      stp->e[k][l] = Complx{0.0, 0.0};
+  for (int nu = 0; nu < 4; ++nu) {
+    if (nu == mu)
+      continue;
+    const site &xnu = a[neighbor(a[i], nu, 1, dims)];
+    mult_su3_nn(&a[i].link[nu], &xnu.link[mu], &tmp1);
+    mult_su3_na(&tmp1, &xmu.link[nu], &tmp2);
+    add_su3_matrix(stp, &tmp2, stp);
+
+    const site &xmnu = a[neighbor(a[i], nu, -1, dims)];
+    const site &xmnumu = a[neighbor(xmnu, mu, 1, dims)];
+    mult_su3_an(&xmnu.link[nu], &xmnu.link[mu], &tmp1);
+    mult_su3_nn(&tmp1, &xmnumu.link[nu], &tmp2);
+    add_su3_matrix(stp, &tmp2, stp);
+  }
+}
+
+// flops of site_staple, twelve products and twelve additions of 3*3 complex
+#define STAPLE_FLOPS (12*216 + 12*18)
+
+// the largest unitarity deviation of any link
+static double max_unitarity_deviation(const site *a, size_t total_sites)
+{
+  double dev = 0.0;
+  #pragma omp parallel for reduction(max:dev)
+  for (size_t i = 0; i < total_sites; ++i)
+    for (int j = 0; j < 4; ++j)
+      dev = std::max(dev, unitarity_deviation(&a[i].link[j]));
+  return dev;
+}
+
+#endif  // _GAUGE_OPENMP2_HPP
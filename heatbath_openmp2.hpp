@@ -0,0 +1,263 @@
+#ifndef _HEATBATH_OPENMP2_HPP
+#define _HEATBATH_OPENMP2_HPP
+// Pure gauge update mode
+// Cabibbo-Marinari heatbath and overrelaxation of the Wilson gauge action.
+// Each link U is updated in the three SU(2) subgroups of SU(3) in turn.  With
+// C the staple sum of the link and W = U C^+, the 2x2 block of W in the subgroup
+// is projected onto k V, V in SU(2), and U is multiplied from the left by
+//   heatbath       R = X V^+, X drawn from exp(2 beta k x0 / 3) by Kennedy-Pendleton
+//   overrelaxation R = V^+ V^+, which leaves Re Tr(U C^+) unchanged
+// and the link is reunitarized afterwards.  Links of one direction and one
+// parity share no staples, so they are updated in parallel a parity at a time.
+// Every site has its own random number stream, so the result does not depend on
+// the number of threads.  An iteration is one heatbath sweep followed by -O
+// overrelaxation sweeps.
+//   -b beta  -O overrelaxation sweeps per heatbath sweep
+#include <omp.h>
+#include "gauge_openmp2.hpp"
+#include "plaq_openmp2.hpp"
+
+#ifndef HEATBATH_EPS
+#  define HEATBATH_EPS 0.5  // roughness of the starting field
+#endif
+#ifndef HEATBATH_MAX_TRIALS
+#  define HEATBATH_MAX_TRIALS 100  // Kennedy-Pendleton trials before the link is left unchanged
+#endif
+
+// the SU(2) matrix v0 + i v.sigma, acting on rows p and q of a 3x3 matrix
+//   [ v0 + i v3   v2 + i v1 ]
+//   [-v2 + i v1   v0 - i v3 ]
+struct su2_matrix { double v[4]; };
+
+// k V, the projection of the (p,q) block of W onto the multiples of SU(2)
+static inline double su2_extract(const su3_matrix *w, int p, int q, su2_matrix &a)
+{
+  a.v[0] = (CREAL(w->e[p][p]) + CREAL(w->e[q][q])) / 2;
+  a.v[1] = (CIMAG(w->e[p][q]) + CIMAG(w->e[q][p])) / 2;
+  a.v[2] = (CREAL(w->e[p][q]) - CREAL(w->e[q][p])) / 2;
+  a.v[3] = (CIMAG(w->e[p][p]) - CIMAG(w->e[q][q])) / 2;
+  const double k = sqrt(a.v[0]*a.v[0] + a.v[1]*a.v[1] + a.v[2]*a.v[2] + a.v[3]*a.v[3]);
+  for (int n = 0; n < 4; ++n)
+    a.v[n] = k > 0.0 ? a.v[n] / k : (n == 0 ? 1.0 : 0.0);
+  return k;
+}
+
+// C = A*B in the quaternion form
+static inline su2_matrix su2_mult(const su2_matrix &a, const su2_matrix &b)
+{
+  su2_matrix c;
+  c.v[0] = a.v[0]*b.v[0] - a.v[1]*b.v[1] - a.v[2]*b.v[2] - a.v[3]*b.v[3];
+  c.v[1] = a.v[0]*b.v[1] + b.v[0]*a.v[1] - (a.v[2]*b.v[3] - a.v[3]*b.v[2]);
+  c.v[2] = a.v[0]*b.v[2] + b.v[0]*a.v[2] - (a.v[3]*b.v[1] - a.v[1]*b.v[3]);
+  c.v[3] = a.v[0]*b.v[3] + b.v[0]*a.v[3] - (a.v[1]*b.v[2] - a.v[2]*b.v[1]);
+  return c;
+}
+
+static inline su2_matrix su2_adjoint(const su2_matrix &a)
+{
+  return su2_matrix{{a.v[0], -a.v[1], -a.v[2], -a.v[3]}};
+}
+
+// rows p and q of M  <-  R * rows p and q of M
+static inline void left_su2_mult(const su2_matrix &r, int p, int q, su3_matrix *m)
+{
+  const Complx r00 = {(Real)r.v[0], (Real)r.v[3]}, r01 = {(Real)r.v[2], (Real)r.v[1]};
+  const Complx r10 = {(Real)-r.v[2], (Real)r.v[1]}, r11 = {(Real)r.v[0], (Real)-r.v[3]};
+  for (int j = 0; j < 3; ++j) {
+    Complx x = {0.0, 0.0}, y = {0.0, 0.0};
+    CMULSUM(r00, m->e[p][j], x);
+    CMULSUM(r01, m->e[q][j], x);
+    CMULSUM(r10, m->e[p][j], y);
+    CMULSUM(r11, m->e[q][j], y);
+    m->e[p][j] = x;
+    m->e[q][j] = y;
+  }
+}
+
+// draws X with density sqrt(1 - x0^2) exp(alpha x0) by Kennedy-Pendleton,
+// returns false when no trial was accepted
+static inline bool su2_heatbath(double alpha, SiteRng &rng, su2_matrix &x, size_t &trials)
+{
+  double x0 = 0.0;
+  bool accepted = false;
+  for (int n = 0; n < HEATBATH_MAX_TRIALS && !accepted; ++n) {
+    ++trials;
+    const double r1 = 1.0 - rng.uniform(), r2 = rng.uniform(), r3 = 1.0 - rng.uniform();
+    const double c = cos(2 * M_PI * r2);
+    const double lambda2 = -(log(r1) + c * c * log(r3)) / (2 * alpha);
+    const double r4 = rng.uniform();
+    if (r4 * r4 <= 1.0 - lambda2) {
+      x0 = 1.0 - 2 * lambda2;
+      accepted = true;
+    }
+  }
+  if (!accepted)
+    return false;
+  // the other components are uniform on the sphere of radius sqrt(1 - x0^2)
+  const double r = sqrt(std::max(0.0, 1.0 - x0 * x0));
+  const double cos_theta = 2 * rng.uniform() - 1, phi = 2 * M_PI * rng.uniform();
+  const double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+  x = su2_matrix{{x0, r * sin_theta * cos(phi), r * sin_theta * sin(phi), r * cos_theta}};
+  return true;
+}
+
+// Kennedy-Pendleton trials and accepted subgroup updates
+struct UpdateCount {
+  size_t trials = 0, accepted = 0;
+};
+
+// updates link mu of the listed sites, by heatbath when heatbath is set
+static void update_links(site *a, const std::vector<size_t> &sites, int mu, const size_t dims[4],
+                         double beta, bool heatbath, SiteRng *rng, UpdateCount &count)
+{
+  size_t trials = 0, accepted = 0;
+  #pragma omp parallel for reduction(+:trials,accepted)
+  for (size_t s = 0; s < sites.size(); ++s) {
+    const size_t i = sites[s];
+    su3_matrix stp, w;
+    su3_matrix &u = a[i].link[mu];
+    site_staple(a, i, mu, dims, &stp);
+    mult_su3_na(&u, &stp, &w);
+    for (int p = 0; p < 2; ++p)
+      for (int q = p + 1; q < 3; ++q) {
+        su2_matrix v, r;
+        const double k = su2_extract(&w, p, q, v);
+        if (heatbath) {
+          su2_matrix x;
+          if (!su2_heatbath(2 * beta * k / 3, rng[i], x, trials))
+            continue;
+          ++accepted;
+          r = su2_mult(x, su2_adjoint(v));
+        } else {
+          r = su2_mult(su2_adjoint(v), su2_adjoint(v));
+        }
+        left_su2_mult(r, p, q, &u);
+        left_su2_mult(r, p, q, &w);
+      }
+    reunit_su3(&u);
+  }
+  count.trials += trials;
+  count.accepted += accepted;
+}
+
+// one sweep over all links, a direction and a parity at a time
+static void gauge_sweep(site *a, const std::vector<size_t> parity_sites[2], const size_t dims[4],
+                        double beta, bool heatbath, SiteRng *rng, UpdateCount &count)
+{
+  for (int mu = 0; mu < 4; ++mu)
+    for (int par = 0; par < 2; ++par)
+      update_links(a, parity_sites[par], mu, dims, beta, heatbath, rng, count);
+}
+
+int run_heatbath(const size_t dims[4], size_t iterations, double beta, int or_sweeps)
+{
+  for (int d = 0; d < 4; ++d)
+    if (dims[d] % 2 != 0) {
+      fprintf(stderr, "ERROR: Heatbath mode requires even lattice dimensions\n");
+      return EXIT_FAILURE;
+    }
+  if (beta <= 0.0 || or_sweeps < 0) {
+    fprintf(stderr, "ERROR: Heatbath mode requires beta > 0 and overrelaxation sweeps >= 0\n");
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Heatbath mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  first_touch(a.data(), b.data(), NULL, total_sites);
+  make_gauge(a.data(), dims, HEATBATH_EPS);
+  std::vector<double> partial(reduce_blocks(total_sites));
+
+  std::vector<size_t> parity_sites[2];
+  for (size_t i = 0; i < total_sites; ++i)
+    parity_sites[a[i].parity == EVEN ? 0 : 1].push_back(i);
+  std::vector<SiteRng> rng(total_sites);
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i)
+    rng[i] = SiteRng(GAUGE_SEED + 1, i);
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations of 1 heatbath and %d overrelaxation sweeps at beta %g with %zu warmups on %d threads\n",
+           iterations, or_sweeps, beta, warmups, omp_get_max_threads());
+  }
+
+  double tdummy = 0.0;
+  const double plaq0 = plaquette(a.data(), partial.data(), total_sites, dims, tdummy, tdummy);
+  UpdateCount hb, ovr, discard;
+  double thb = 0.0, tor = 0.0;
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    const bool timed = iters >= warmups;
+    auto t0 = Clock::now();
+    {
+      TRACE_ZONE("heatbath sweep");
+      gauge_sweep(a.data(), parity_sites, dims, beta, true, rng.data(), timed ? hb : discard);
+    }
+    auto t1 = Clock::now();
+    for (int n = 0; n < or_sweeps; ++n) {
+      TRACE_ZONE("overrelaxation sweep");
+      gauge_sweep(a.data(), parity_sites, dims, beta, false, rng.data(), timed ? ovr : discard);
+    }
+    auto t2 = Clock::now();
+    if (timed) {
+      thb += std::chrono::duration<double>(t1-t0).count();
+      tor += std::chrono::duration<double>(t2-t1).count();
+    }
+  }
+  const double plaq1 = plaquette(a.data(), partial.data(), total_sites, dims, tdummy, tdummy);
+
+  // overrelaxation leaves the action unchanged, up to the reunitarization
+  gauge_sweep(a.data(), parity_sites, dims, beta, false, rng.data(), discard);
+  const double plaq2 = plaquette(a.data(), partial.data(), total_sites, dims, tdummy, tdummy);
+  const double dev = max_unitarity_deviation(a.data(), total_sites);
+
+  // per link: the staples, W = U C^+, and per subgroup the extraction (12 flops)
+  // and two 2x3 left multiplications (2*6*14 flops), then the reunitarization;
+  // the random numbers and transcendental functions of the heatbath are not counted
+  const double link_flops = STAPLE_FLOPS + 216 + 3 * (12 + 168) + 150;
+  const double links = 4.0 * total_sites;
+  const double nhb = (double)iterations, nor = (double)iterations * or_sweeps;
+  printf("Heatbath: %.3f ns per link, %.3f GFLOP/s, acceptance %.4f\n",
+         thb / (nhb * links) * 1.0e9, nhb * links * link_flops / thb / 1.0e9,
+         hb.trials > 0 ? (double)hb.accepted / hb.trials : 0.0);
+  if (hb.accepted < 3 * nhb * links)
+    printf("Heatbath left %.0f subgroup updates unchanged after %d trials\n",
+           3 * nhb * links - hb.accepted, HEATBATH_MAX_TRIALS);
+  if (or_sweeps > 0)
+    printf("Overrelaxation: %.3f ns per link, %.3f GFLOP/s\n",
+           tor / (nor * links) * 1.0e9, nor * links * link_flops / tor / 1.0e9);
+  printf("Total GByte/s (GB/s) = %.3f gathered\n", (nhb + nor) * links * 20.0 * sizeof(su3_matrix) / (thb + tor) / 1.0e9);
+  printf("Plaquette = %.8f before, %.8f after, %.8f after one more overrelaxation sweep\n", plaq0, plaq1, plaq2);
+  printf("Unitarity deviation = %.3e\n", dev);
+
+  bool ok = true;
+  const double tol = sizeof(Real) == 4 ? 1E-4 : 1E-8;
+  if (hb.accepted == 0) {
+    fprintf(stderr, "Heatbath accepted none of %zu trials\n", hb.trials);
+    ok = false;
+  }
+  if (fabs(plaq2 - plaq1) > tol) {
+    fprintf(stderr, "Overrelaxation changed the plaquette by %.3e\n", plaq2 - plaq1);
+    ok = false;
+  }
+  if (dev > tol) {
+    fprintf(stderr, "Unitarity deviation %.3e exceeds %.0e\n", dev, tol);
+    ok = false;
+  }
+  if (!(plaq1 > 0.0 && plaq1 < 1.0)) {
+    fprintf(stderr, "Plaquette %.8f is outside (0,1)\n", plaq1);
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _HEATBATH_OPENMP2_HPP
@@ -0,0 +1,368 @@
+#ifndef _HMC_OPENMP2_HPP
+#define _HMC_OPENMP2_HPP
+// Molecular dynamics link update mode
+// Every iteration applies the gauge field update of an HMC integrator step,
+//   U  <-  exp(eps H) U
+// in place to all links, with H the anti-hermitian traceless momentum of the
+// link.  The exponential is selected with -x,
+//   cayley  the exact exponential by the Cayley-Hamilton theorem,
+//           exp(iQ) = f0 + f1 Q + f2 Q^2 with Q = -i eps H  (Morningstar and Peardon)
+//   taylor  the Taylor series to the given order, SU3_EXP_ORDER by default
+// Both are evaluated in the precision of the build.  The same updates are
+// applied to a copy of the links in double precision, with the exponential by
+// scaling and squaring, and the unitarity drift of the field is reported
+// against that reference.
+//   -x cayley|taylor[,order]  -e step
+#include <complex>
+#include <limits>
+#include <omp.h>
+#include "gauge_openmp2.hpp"
+
+#ifndef HMC_EPS
+#  define HMC_EPS 0.5  // roughness of the starting field
+#endif
+#ifndef HMC_MAX_TRUNCATION
+#  define HMC_MAX_TRUNCATION 1E-6  // largest Taylor truncation bound per update
+#endif
+
+//  Anti-hermitian traceless matrices, for the momenta
+//  the upper triangle and the imaginary parts of the diagonal, as in MILC
+typedef struct {
+  Complx m01, m02, m12;
+  Real m00im, m11im, m22im;
+  Real space;
+} anti_hermitmat;
+
+//*******************  uncmp_ahmat.c  (in su3.a) **************************
+//  void uncompress_anti_hermitian( anti_hermitmat *mat_antihermit,
+//	su3_matrix *mat_su3 )
+//  uncompresses an anti_hermitian matrix to make a 3x3 complex matrix
+static inline void uncompress_anti_hermitian(const anti_hermitmat *ah, su3_matrix *m)
+{
+  m->e[0][0] = Complx{0.0, ah->m00im};
+  m->e[1][1] = Complx{0.0, ah->m11im};
+  m->e[2][2] = Complx{0.0, ah->m22im};
+  m->e[0][1] = ah->m01;
+  m->e[0][2] = ah->m02;
+  m->e[1][2] = ah->m12;
+  Complx y;
+  CONJG(ah->m01, y); CMULREAL(y, (Real)-1.0, m->e[1][0]);
+  CONJG(ah->m02, y); CMULREAL(y, (Real)-1.0, m->e[2][0]);
+  CONJG(ah->m12, y); CMULREAL(y, (Real)-1.0, m->e[2][1]);
+}
+
+typedef std::complex<double> dcplx;
+
+// E = exp(A) for A anti-hermitian and traceless, evaluated in the precision of T
+template <class T>
+static void cayley_exp(const std::complex<T> a[3][3], std::complex<T> e[3][3])
+{
+  typedef std::complex<T> cplx;
+  // Q = -iA is hermitian and traceless
+  cplx q[3][3], q2[3][3];
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      q[i][j] = cplx(a[i][j].imag(), -a[i][j].real());
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) {
+      q2[i][j] = 0.0;
+      for (int k = 0; k < 3; ++k)
+        q2[i][j] += q[i][k] * q[k][j];
+    }
+  T c0 = 0, c1 = 0;
+  for (int i = 0; i < 3; ++i) {
+    c1 += q2[i][i].real() / 2;
+    for (int k = 0; k < 3; ++k)
+      c0 += (q[i][k] * q2[k][i]).real() / 3;
+  }
+
+  cplx f0, f1, f2;
+  if (c1 < std::numeric_limits<T>::epsilon()) {
+    // near Q = 0 the expansion of exp(iQ) to second order is exact to the precision of T
+    f0 = 1; f1 = cplx(0, 1); f2 = T(-0.5);
+  } else {
+    // f_j(-c0) = (-1)^j conj(f_j(c0)), so the coefficients are found for |c0|
+    const bool negative = c0 < 0;
+    c0 = std::abs(c0);
+    const T c0max = 2 * std::pow(c1 / 3, T(1.5));
+    const T theta = std::acos(std::min(T(1), c0 / c0max));
+    const T u = std::sqrt(c1 / 3) * std::cos(theta / 3), w = std::sqrt(c1) * std::sin(theta / 3);
+    const T u2 = u * u, w2 = w * w;
+    const T xi0 = std::abs(w) < T(0.05) ? 1 - w2 / 6 * (1 - w2 / 20 * (1 - w2 / 42)) : std::sin(w) / w;
+    const cplx e2iu = std::polar(T(1), 2 * u), emiu = std::polar(T(1), -u);
+    const cplx h0 = (u2 - w2) * e2iu + emiu * cplx(8 * u2 * std::cos(w), 2 * u * (3 * u2 + w2) * xi0);
+    const cplx h1 = 2 * u * e2iu - emiu * cplx(2 * u * std::cos(w), -(3 * u2 - w2) * xi0);
+    const cplx h2 = e2iu - emiu * cplx(std::cos(w), 3 * u * xi0);
+    const T d = 9 * u2 - w2;
+    f0 = h0 / d; f1 = h1 / d; f2 = h2 / d;
+    if (negative) {
+      f0 = std::conj(f0); f1 = -std::conj(f1); f2 = std::conj(f2);
+    }
+  }
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      e[i][j] = (i == j ? f0 : cplx(0)) + f1 * q[i][j] + f2 * q2[i][j];
+}
+
+// B  <-  exp(A) by Cayley-Hamilton, A anti-hermitian and traceless
+static inline void exp_su3_cayley(const su3_matrix *a, su3_matrix *b)
+{
+  std::complex<Real> x[3][3], y[3][3];
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      x[i][j] = std::complex<Real>(CREAL(a->e[i][j]), CIMAG(a->e[i][j]));
+  cayley_exp(x, y);
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      b->e[i][j] = Complx{y[i][j].real(), y[i][j].imag()};
+}
+
+// parses cayley|taylor[,order], order is 0 for cayley
+static bool parse_exp(const std::string &spec, int &order)
+{
+  const std::string name = spec.substr(0, spec.find(','));
+  if (name == "cayley")
+    order = 0;
+  else if (name == "taylor")
+    order = spec.find(',') != std::string::npos ? atoi(spec.substr(spec.find(',') + 1).c_str()) : SU3_EXP_ORDER;
+  else
+    return false;
+  return order >= 0 && (name == "cayley" || order > 0);
+}
+
+// U  <-  exp(eps H) U for every link, in place
+static void k_hmc_update(site *a, const anti_hermitmat *mom, size_t total_sites, Real eps, int order)
+{
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i)
+    for (int mu = 0; mu < 4; ++mu) {
+      su3_matrix h, e, u;
+      uncompress_anti_hermitian(&mom[4*i + mu], &h);
+      scalar_mult_su3_matrix(&h, eps, &h);
+      if (order == 0)
+        exp_su3_cayley(&h, &e);
+      else
+        exp_su3_taylor(&h, order, &e);
+      mult_su3_nn(&e, &a[i].link[mu], &u);
+      a[i].link[mu] = u;
+    }
+}
+
+// E = exp(A) in double precision by scaling and squaring, independent of the
+// exponentials under test: the Taylor series of A/2^s to order 16 with the norm
+// of A/2^s below 1/4, squared s times
+static void ref_exp(const dcplx a[3][3], dcplx e[3][3])
+{
+  double norm = 0.0;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      norm += std::norm(a[i][j]);
+  int s = 0;
+  for (double x = sqrt(norm); x > 0.25; x /= 2)
+    ++s;
+  const double scale = std::ldexp(1.0, -s);
+
+  dcplx term[3][3], next[3][3];
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      e[i][j] = term[i][j] = i == j ? 1.0 : 0.0;
+  for (int n = 1; n <= 16; ++n) {
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) {
+        next[i][j] = 0.0;
+        for (int k = 0; k < 3; ++k)
+          next[i][j] += term[i][k] * a[k][j];
+        next[i][j] *= scale / n;
+      }
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) {
+        term[i][j] = next[i][j];
+        e[i][j] += term[i][j];
+      }
+  }
+  for (; s > 0; --s) {
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) {
+        next[i][j] = 0.0;
+        for (int k = 0; k < 3; ++k)
+          next[i][j] += e[i][k] * e[k][j];
+      }
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        e[i][j] = next[i][j];
+  }
+}
+
+// the same update of the double precision reference links
+static void ref_hmc_update(dcplx *ref, const anti_hermitmat *mom, size_t total_links, double eps)
+{
+  #pragma omp parallel for
+  for (size_t l = 0; l < total_links; ++l) {
+    su3_matrix h;
+    uncompress_anti_hermitian(&mom[l], &h);
+    dcplx x[3][3], e[3][3], u[3][3];
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        x[i][j] = eps * dcplx(CREAL(h.e[i][j]), CIMAG(h.e[i][j]));
+    ref_exp(x, e);
+    dcplx *r = ref + 9*l;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) {
+        u[i][j] = 0.0;
+        for (int k = 0; k < 3; ++k)
+          u[i][j] += e[i][k] * r[3*k + j];
+      }
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        r[3*i + j] = u[i][j];
+  }
+}
+
+// momenta uniform in [-1,1) per real component, traceless
+static void make_momenta(anti_hermitmat *mom, size_t total_sites)
+{
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i) {
+    SiteRng rng(GAUGE_SEED + 2, i);
+    for (int mu = 0; mu < 4; ++mu) {
+      anti_hermitmat &h = mom[4*i + mu];
+      h.m01 = Complx{(Real)(2 * rng.uniform() - 1), (Real)(2 * rng.uniform() - 1)};
+      h.m02 = Complx{(Real)(2 * rng.uniform() - 1), (Real)(2 * rng.uniform() - 1)};
+      h.m12 = Complx{(Real)(2 * rng.uniform() - 1), (Real)(2 * rng.uniform() - 1)};
+      const double d0 = 2 * rng.uniform() - 1, d1 = 2 * rng.uniform() - 1;
+      h.m00im = d0;
+      h.m11im = d1;
+      h.m22im = -d0 - d1;
+      h.space = 0.0;
+    }
+  }
+}
+
+int run_hmc(const size_t dims[4], size_t iterations, const std::string &exp_spec, double eps)
+{
+  int order;
+  if (!parse_exp(exp_spec, order)) {
+    fprintf(stderr, "ERROR: Unknown exponential %s (cayley|taylor[,order])\n", exp_spec.c_str());
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: HMC mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  const size_t total_links = 4*total_sites;
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<anti_hermitmat> mom(total_links);
+  first_touch(a.data(), b.data(), NULL, total_sites);
+  make_gauge(a.data(), dims, HMC_EPS);
+
+  make_momenta(mom.data(), total_sites);
+
+  // the truncation error of the Taylor series per update is bounded by
+  // x^(N+1)/(N+1)! e^x for x the largest norm of eps H, and the order and
+  // step must keep it below HMC_MAX_TRUNCATION
+  double truncation = 0.0;
+  if (order > 0) {
+    double hmax = 0.0;
+    #pragma omp parallel for reduction(max:hmax)
+    for (size_t l = 0; l < total_links; ++l) {
+      su3_matrix h;
+      uncompress_anti_hermitian(&mom[l], &h);
+      double norm = 0.0;
+      for (int k = 0; k < 3; ++k)
+        for (int m = 0; m < 3; ++m)
+          norm += CREAL(h.e[k][m]) * CREAL(h.e[k][m]) + CIMAG(h.e[k][m]) * CIMAG(h.e[k][m]);
+      hmax = std::max(hmax, sqrt(norm));
+    }
+    const double x = fabs(eps) * hmax;
+    truncation = exp(x);
+    for (int n = 1; n <= order + 1; ++n)
+      truncation *= x / n;
+    if (!(truncation <= HMC_MAX_TRUNCATION)) {
+      fprintf(stderr, "ERROR: The Taylor series of order %d with step %g has a truncation bound of %.1e, above %.0e\n",
+              order, eps, truncation, HMC_MAX_TRUNCATION);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<dcplx> ref(9*total_links);
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i)
+    for (int mu = 0; mu < 4; ++mu)
+      for (int k = 0; k < 3; ++k)
+        for (int l = 0; l < 3; ++l)
+          ref[9*(4*i + mu) + 3*k + l] = dcplx(CREAL(a[i].link[mu].e[k][l]), CIMAG(a[i].link[mu].e[k][l]));
+  const double dev0 = max_unitarity_deviation(a.data(), total_sites);
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    if (order == 0)
+      printf("Executing %zu iterations with %zu warmups, exact exponential, step %g\n", iterations, warmups, eps);
+    else
+      printf("Executing %zu iterations with %zu warmups, Taylor exponential of order %d, step %g\n",
+             iterations, warmups, order, eps);
+  }
+
+  Profile profile;
+  const double ttotal = time_iterations(iterations, &profile, [&]() {
+    k_hmc_update(a.data(), mom.data(), total_sites, (Real)eps, order);
+  });
+  for (size_t iters = 0; iters < iterations + warmups; ++iters)
+    ref_hmc_update(ref.data(), mom.data(), total_links, eps);
+
+  // the drift from unitarity, and the distance from the reference links
+  double dev = 0.0, diff = 0.0;
+  #pragma omp parallel for reduction(max:dev,diff)
+  for (size_t i = 0; i < total_sites; ++i)
+    for (int mu = 0; mu < 4; ++mu) {
+      dev = std::max(dev, unitarity_deviation(&a[i].link[mu]));
+      for (int k = 0; k < 3; ++k)
+        for (int l = 0; l < 3; ++l) {
+          const dcplx r = ref[9*(4*i + mu) + 3*k + l];
+          const dcplx u(CREAL(a[i].link[mu].e[k][l]), CIMAG(a[i].link[mu].e[k][l]));
+          diff = std::max(diff, std::abs(u - r));
+        }
+    }
+
+  // per link: uncompress and scale (18), the exponential and one matrix product;
+  // cayley forms Q^2 (216), the traces (24) and f0 + f1 Q + f2 Q^2 (144), taylor
+  // takes a product, scaling and addition per order
+  const double exp_flops = order == 0 ? 216 + 24 + 144 : order * (216 + 20);
+  const double flops = total_links * (18 + exp_flops + 216);
+  // per link the momentum and the link are read and the link is written
+  const double bytes = total_links * (sizeof(anti_hermitmat) + 2.0 * sizeof(su3_matrix));
+  if (verbose >= 1) {
+    printf("Total execution time = %f secs\n", ttotal);
+    printf("host_to_device_ms,kernel_ms,device_to_host_ms,num_iterations,num_warmups\n");
+    printf("%f,%f,%f,%lu,%lu\n", profile.host_to_device_time*1000, profile.kernel_time*1000,
+           profile.device_to_host_time*1000, iterations, warmups);
+  }
+  printf("Arithmetic intensity = %.3f flop/byte\n", flops / bytes);
+  printf("Total GFLOP/s = %.3f\n", iterations * flops / ttotal / 1.0e9);
+  printf("Total GByte/s (GB/s) = %.3f\n", iterations * bytes / ttotal / 1.0e9);
+  printf("Time per link = %.3f ns\n", ttotal / iterations / total_links * 1.0e9);
+  printf("Unitarity deviation = %.3e before, %.3e after %zu updates\n", dev0, dev, iterations + warmups);
+  printf("Distance from the double precision reference = %.3e\n", diff);
+
+  // the drift grows with the number of updates, allow a rounding error per
+  // update, and for the Taylor series its truncation error
+  const double tol = ((sizeof(Real) == 4 ? 1E-6 : 1E-13) + 2 * truncation) * (iterations + warmups + 10);
+  bool ok = true;
+  if (dev > tol) {
+    fprintf(stderr, "Unitarity deviation %.3e exceeds %.1e\n", dev, tol);
+    ok = false;
+  }
+  if (diff > tol) {
+    fprintf(stderr, "Distance from the reference %.3e exceeds %.1e\n", diff, tol);
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _HMC_OPENMP2_HPP
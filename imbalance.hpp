@@ -0,0 +1,148 @@
+#ifndef _IMBALANCE_HPP
+#define _IMBALANCE_HPP
+// Load imbalance mode
+// Runs the C = A*B site loop with the schedule selected by -s, recording for each
+// thread and iteration the time spent on its sites, the number of sites and the
+// time spent idle at the barrier that closes the loop.  It reports the max/mean
+// imbalance, the share of the run lost at the barrier and the slowest threads
+// together with the cpu they ran on.  The lattice setup is timed per thread too.
+//   -s static|dynamic|guided[,chunk]
+#include <algorithm>
+#include <numeric>
+#include <omp.h>
+#include <sched.h>
+
+#ifndef IMBALANCE_SLOWEST
+#  define IMBALANCE_SLOWEST 5  // slowest threads listed
+#endif
+
+// parses static|dynamic|guided[,chunk] into an OpenMP runtime schedule
+static bool parse_schedule(const std::string &spec, omp_sched_t &kind, int &chunk)
+{
+  const std::string name = spec.substr(0, spec.find(','));
+  chunk = spec.find(',') == std::string::npos ? 0 : atoi(spec.substr(spec.find(',') + 1).c_str());
+  if (name == "static")
+    kind = omp_sched_static;
+  else if (name == "dynamic")
+    kind = omp_sched_dynamic;
+  else if (name == "guided")
+    kind = omp_sched_guided;
+  else
+    return false;
+  return chunk >= 0;
+}
+
+int run_imbalance(const size_t dims[4], size_t iterations, const std::string &schedule)
+{
+  omp_sched_t kind;
+  int chunk;
+  if (!parse_schedule(schedule, kind, chunk)) {
+    fprintf(stderr, "ERROR: Unknown schedule %s (static|dynamic|guided[,chunk])\n", schedule.c_str());
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Imbalance mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+  omp_set_schedule(kind, chunk);
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<site> c(total_sites);
+  const int threads = omp_get_max_threads();
+  std::vector<double> setup(threads, 0.0);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0}, setup.data());
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+
+  std::vector<double> busy(iterations * threads), idle(iterations * threads), wall(iterations);
+  std::vector<size_t> sites(iterations * threads);
+  std::vector<int> cpu(threads);
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, threads);
+    printf("Schedule set to %s\n", schedule.c_str());
+  }
+
+  site *d_a = a.data();
+  su3_matrix *d_b = b.data();
+  site *d_c = c.data();
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    const double tstart = omp_get_wtime();
+    #pragma omp parallel num_threads(threads)
+    {
+      const int tid = omp_get_thread_num();
+      size_t n = 0;
+      const double t0 = omp_get_wtime();
+      #pragma omp for schedule(runtime) nowait
+      for (size_t i = 0; i < total_sites; ++i) {
+        mult_su3_site(&d_a[i], d_b, d_c[i].link);
+        ++n;
+      }
+      const double t1 = omp_get_wtime();
+      #pragma omp barrier
+      const double t2 = omp_get_wtime();
+      if (iters >= warmups) {
+        const size_t k = (iters - warmups) * threads + tid;
+        busy[k] = t1 - t0;
+        idle[k] = t2 - t1;
+        sites[k] = n;
+        cpu[tid] = sched_getcpu();
+      }
+    }
+    if (iters >= warmups)
+      wall[iters - warmups] = omp_get_wtime() - tstart;
+  }
+
+  // per iteration max/mean busy time, and the barrier idle share of the thread time
+  double imbalance_mean = 0.0, imbalance_max = 0.0, idle_total = 0.0;
+  std::vector<double> thread_busy(threads, 0.0);
+  std::vector<size_t> thread_sites(threads, 0), straggler(threads, 0);
+  for (size_t it = 0; it < iterations; ++it) {
+    const double *t = &busy[it * threads];
+    const int slowest = std::max_element(t, t + threads) - t;
+    const double mean = std::accumulate(t, t + threads, 0.0) / threads;
+    const double ratio = mean > 0.0 ? t[slowest] / mean : 1.0;
+    imbalance_mean += ratio / iterations;
+    imbalance_max = std::max(imbalance_max, ratio);
+    straggler[slowest]++;
+    for (int th = 0; th < threads; ++th) {
+      idle_total += idle[it * threads + th];
+      thread_busy[th] += t[th] / iterations;
+      thread_sites[th] += sites[it * threads + th];
+    }
+  }
+  const double ttotal = std::accumulate(wall.begin(), wall.end(), 0.0);
+
+  printf("Total GFLOP/s = %.3f\n", iterations * 864.0 * total_sites / ttotal / 1.0e9);
+  printf("Imbalance max/mean busy time: mean %.3f, worst %.3f\n", imbalance_mean, imbalance_max);
+  printf("Idle time at the barrier = %.2f%% of the thread time\n", 100.0 * idle_total / (ttotal * threads));
+  const double setup_max = *std::max_element(setup.begin(), setup.end());
+  const double setup_mean = std::accumulate(setup.begin(), setup.end(), 0.0) / threads;
+  printf("Lattice setup per thread: mean %.2f us, max %.2f us, max/mean %.3f\n",
+         setup_mean * 1.0e6, setup_max * 1.0e6, setup_mean > 0.0 ? setup_max / setup_mean : 1.0);
+  printf("Sites per thread per iteration: min %zu, max %zu\n",
+         *std::min_element(thread_sites.begin(), thread_sites.end()) / iterations,
+         *std::max_element(thread_sites.begin(), thread_sites.end()) / iterations);
+
+  std::vector<int> order(threads);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int x, int y) { return thread_busy[x] > thread_busy[y]; });
+  const double busy_mean = std::accumulate(thread_busy.begin(), thread_busy.end(), 0.0) / threads;
+  printf("%8s %6s %12s %10s %12s %10s\n", "thread", "cpu", "busy_us", "vs_mean", "sites", "slowest");
+  for (int r = 0; r < std::min(threads, IMBALANCE_SLOWEST); ++r) {
+    const int th = order[r];
+    printf("%8d %6d %12.2f %10.3f %12zu %10zu\n", th, cpu[th], thread_busy[th] * 1.0e6,
+           thread_busy[th] / busy_mean, thread_sites[th] / iterations, straggler[th]);
+  }
+
+  if (!verify_mat_nn(a, b, c, total_sites)) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _IMBALANCE_HPP
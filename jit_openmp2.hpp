@@ -0,0 +1,327 @@
+#ifndef _JIT_OPENMP2_HPP
+#define _JIT_OPENMP2_HPP
+// JIT specialisation mode
+// Generates the C++ source of C = A*B for the configuration of the run, with
+// the number of sites, the site layout, the precision, the chunk of the static
+// schedule (-t sites) and the SIMD width of the host as constants, and the 3x3
+// products written out in full.  It is compiled by the local compiler (JIT_CXX JIT_FLAGS JIT_ARCH) into a
+// shared object that is loaded with dlopen.  With the array of site structs
+// an omp simd loop across sites turns every load into a gather, so by default
+// (JIT_SIMD 0) the SIMD width enters through JIT_ARCH and the products within
+// a site are vectorized.  The objects are cached in JIT_CACHE_DIR, or the -C
+// directory, keyed by a hash of the source, the compile command and the target
+// the compiler resolves it to, so later runs on the same CPU skip the compile;
+// -C none disables the cache.  Objects are compiled under a temporary name and
+// renamed into place.  The JIT kernel is timed against the generic site loop
+// with the same schedule, and the compile or cache load time is reported
+// separately, with the number of iterations after which the compile pays off.
+//   -t chunk  -C dir|none
+#include <fstream>
+#include <sstream>
+#include <cstddef>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+
+#ifndef JIT_CACHE_DIR
+#  define JIT_CACHE_DIR "su3_jit_cache"
+#endif
+#ifndef JIT_CXX
+#  define JIT_CXX "c++"
+#endif
+#ifndef JIT_FLAGS
+#  define JIT_FLAGS "-O3 -fopenmp"
+#endif
+#ifndef JIT_ARCH
+#  define JIT_ARCH "-march=native"
+#endif
+// vectorize across sites with an omp simd loop of the host width, otherwise
+// the compiler vectorizes the products within a site for JIT_ARCH
+#ifndef JIT_SIMD
+#  define JIT_SIMD 0
+#endif
+
+typedef void (*jit_kernel)(const Real *a, const Real *b, Real *c);
+
+// the widest vector of the host in bytes
+static int jit_vector_bytes()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  if (__builtin_cpu_supports("avx512f"))
+    return 64;
+  if (__builtin_cpu_supports("avx2") || __builtin_cpu_supports("avx"))
+    return 32;
+#endif
+  return 16;
+}
+
+// the source of the kernel, every constant of the configuration baked in
+static std::string jit_source(size_t total_sites, size_t chunk, int simdlen)
+{
+  const char *real = sizeof(Real) == sizeof(float) ? "float" : "double";
+  std::ostringstream src;
+  src << "// C = A*B for " << total_sites << " sites of " << sizeof(site) << " bytes, " << real
+      << ", SIMD width " << simdlen << "\n"
+      << "#define SITES  " << total_sites << "L\n"
+      << "#define STRIDE " << sizeof(site) / sizeof(Real) << "L  // reals per site\n"
+      << "#define OFFSET " << offsetof(site, link) / sizeof(Real) << "L  // reals before the links\n"
+      << "#define CHUNK  " << chunk << "  // sites per static chunk\n"
+      << "extern \"C\" void su3_jit_mat_nn(const " << real << " *__restrict a, const " << real
+      << " *__restrict b, " << real << " *__restrict c)\n"
+      << "{\n"
+      << "  #pragma omp parallel for " << (JIT_SIMD ? "simd simdlen(" + std::to_string(simdlen) + ") " : "")
+      << "schedule(" << (JIT_SIMD ? "simd:" : "") << "static, CHUNK)\n"
+      << "  for (long i = 0; i < SITES; ++i) {\n"
+      << "    const " << real << " *x = a + i*STRIDE + OFFSET;\n"
+      << "    " << real << " *y = c + i*STRIDE + OFFSET;\n";
+  // element (k,l) of link j is at 18j + 6k + 2l, the imaginary part follows
+  for (int j = 0; j < 4; ++j)
+    for (int k = 0; k < 3; ++k)
+      for (int l = 0; l < 3; ++l) {
+        const int y = 18*j + 6*k + 2*l;
+        src << "    y[" << y << "] =";
+        for (int m = 0; m < 3; ++m) {
+          const int x = 18*j + 6*k + 2*m, z = 18*j + 6*m + 2*l;
+          src << (m ? " + " : " ") << "x[" << x << "]*b[" << z << "] - x[" << x+1 << "]*b[" << z+1 << "]";
+        }
+        src << ";\n    y[" << y+1 << "] =";
+        for (int m = 0; m < 3; ++m) {
+          const int x = 18*j + 6*k + 2*m, z = 18*j + 6*m + 2*l;
+          src << (m ? " + " : " ") << "x[" << x << "]*b[" << z+1 << "] + x[" << x+1 << "]*b[" << z << "]";
+        }
+        src << ";\n";
+      }
+  src << "  }\n}\n";
+  return src.str();
+}
+
+// a path as a single shell word
+static std::string shell_quote(const std::string &path)
+{
+  std::string word = "'";
+  for (char ch : path)
+    word += ch == '\'' ? std::string("'\\''") : std::string(1, ch);
+  return word + "'";
+}
+
+// The target the compile command resolves to: the compiler version and the
+// -m flags GCC passes to cc1plus, or the target cpu and features of clang -cc1,
+// so that -march=native keys the cache by the CPU of the host
+static std::string jit_target(const std::string &command)
+{
+  std::string out, target;
+  FILE *pipe = popen((command + " -E -v -x c++ /dev/null 2>&1 >/dev/null").c_str(), "r");
+  if (pipe == NULL)
+    return target;
+  char buf[4096];
+  while (fgets(buf, sizeof(buf), pipe) != NULL)
+    out += buf;
+  pclose(pipe);
+
+  std::istringstream lines(out);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.find(" version ") != std::string::npos && target.empty()) {
+      target = line + '\n';
+    } else if (line.find("cc1") != std::string::npos) {
+      std::istringstream words(line);
+      std::string word, prev;
+      while (words >> word) {
+        if (word.compare(0, 2, "-m") == 0 || prev == "--param" || prev == "-target-cpu" || prev == "-target-feature")
+          target += word + ' ';
+        prev = word;
+      }
+    }
+  }
+  return target;
+}
+
+// opens the shared object and looks up the kernel, NULL when either fails
+static jit_kernel jit_open(const std::string &object, void *&handle)
+{
+  handle = dlopen(object.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == NULL)
+    return NULL;
+  jit_kernel kernel = (jit_kernel)dlsym(handle, "su3_jit_mat_nn");
+  if (kernel == NULL) {
+    dlclose(handle);
+    handle = NULL;
+  }
+  return kernel;
+}
+
+// Builds the kernel, going through the on-disk object cache when enabled
+// The cache is keyed by the kernel source, the compile command and its target
+static jit_kernel jit_build(const std::string &source, const std::string &cache_dir, void *&handle,
+                            double &tcompile, double &tload)
+{
+  const std::string command = std::string(JIT_CXX) + " " + JIT_FLAGS + " " + JIT_ARCH + " -fPIC -shared";
+  const std::string target = jit_target(command);
+  if (verbose >= 2)
+    printf("JIT target %s\n", target.c_str());
+  std::ostringstream key;
+  key << std::hex << std::hash<std::string>{}(command + '\n' + target + '\n' + source);
+  std::string dir = cache_dir;
+  if (cache_dir == "none") {
+    char tmp[] = "/tmp/su3_jit_XXXXXX";
+    if (mkdtemp(tmp) == NULL) {
+      fprintf(stderr, "ERROR: Cannot create a directory for the JIT kernel\n");
+      return NULL;
+    }
+    dir = tmp;
+  }
+  const std::string base = dir + "/k_mat_nn_" + key.str();
+  tcompile = tload = 0.0;
+
+  // try the cache first
+  if (cache_dir != "none") {
+    auto t0 = Clock::now();
+    jit_kernel kernel = jit_open(base + ".so", handle);
+    if (kernel != NULL) {
+      tload = std::chrono::duration<double>(Clock::now()-t0).count();
+      if (verbose >= 1)
+        printf("JIT cache hit %s.so, load time = %f ms\n", base.c_str(), tload * 1.0e3);
+      return kernel;
+    }
+  }
+
+  // compile from source under a name of this process, then rename the files
+  // into the cache, so a concurrent run never loads a partly written object
+  auto t0 = Clock::now();
+  mkdir(dir.c_str(), 0755);
+  const std::string tmp = base + ".tmp" + std::to_string(getpid());
+  std::ofstream(tmp + ".cpp") << source;
+  const std::string compile = command + " -o " + shell_quote(tmp + ".so") + " " + shell_quote(tmp + ".cpp");
+  if (verbose >= 2)
+    printf("%s\n", compile.c_str());
+  if (system(compile.c_str()) != 0) {
+    fprintf(stderr, "ERROR: JIT compile failed: %s\n", compile.c_str());
+    unlink((tmp + ".cpp").c_str());
+    unlink((tmp + ".so").c_str());
+    return NULL;
+  }
+  if (rename((tmp + ".cpp").c_str(), (base + ".cpp").c_str()) != 0
+  ||  rename((tmp + ".so").c_str(), (base + ".so").c_str()) != 0) {
+    fprintf(stderr, "ERROR: Cannot move the JIT kernel into %s\n", dir.c_str());
+    unlink((tmp + ".cpp").c_str());
+    unlink((tmp + ".so").c_str());
+    return NULL;
+  }
+  tcompile = std::chrono::duration<double>(Clock::now()-t0).count();
+  auto t1 = Clock::now();
+  jit_kernel kernel = jit_open(base + ".so", handle);
+  tload = std::chrono::duration<double>(Clock::now()-t1).count();
+  if (kernel == NULL)
+    fprintf(stderr, "ERROR: Cannot load the JIT kernel: %s\n", dlerror());
+  if (verbose >= 1)
+    printf("JIT compile time = %f ms, load time = %f ms\n", tcompile * 1.0e3, tload * 1.0e3);
+
+  // the object stays mapped after the files of an uncached build are removed
+  if (cache_dir == "none") {
+    unlink((base + ".cpp").c_str());
+    unlink((base + ".so").c_str());
+    rmdir(dir.c_str());
+  }
+  return kernel;
+}
+
+template <class Kernel>
+static double time_jit(size_t iterations, Kernel kernel)
+{
+  auto tstart = Clock::now();
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    kernel();
+  }
+  return std::chrono::duration<double>(Clock::now()-tstart).count();
+}
+
+// the generic site loop with the schedule of the JIT kernel
+static void k_mat_nn_chunked(const site *a, const su3_matrix *b, site *c, size_t total_sites, size_t chunk)
+{
+  #pragma omp parallel for schedule(static, chunk)
+  for (size_t i = 0; i < total_sites; ++i)
+    mult_su3_site(&a[i], b, c[i].link);
+}
+
+int run_jit(const size_t dims[4], size_t iterations, size_t chunk)
+{
+  std::string cache_dir = JIT_CACHE_DIR;
+  int opt;
+  optind = 1;
+  while ((opt=getopt(g_argc, g_argv, ":C:")) != -1) {
+    switch (opt) {
+    case 'C':
+      cache_dir = optarg;
+      break;
+    }
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: JIT mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+  if (chunk == 0)
+    chunk = 1;
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<site> c(total_sites);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+
+  const int simdlen = jit_vector_bytes() / sizeof(Real);
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+    printf("Specialised for a chunk of %zu sites and a SIMD width of %d\n", chunk, simdlen);
+  }
+  void *handle = NULL;
+  double tcompile = 0.0, tload = 0.0;
+  jit_kernel kernel = jit_build(jit_source(total_sites, chunk, simdlen), cache_dir, handle, tcompile, tload);
+  if (kernel == NULL)
+    return EXIT_FAILURE;
+
+  const double flops = 864.0 * total_sites;
+  const double bytes = 2.0 * sizeof(site) * total_sites + sizeof(su3_matrix) * 4;
+  bool result = true;
+  double time[2];
+  printf("%10s %12s %12s %12s\n", "kernel", "ms_per_iter", "GFLOP/s", "GByte/s");
+  for (int jit = 0; jit < 2; ++jit) {
+    // C is cleared so each kernel is verified on its own result
+    #pragma omp parallel for
+    for (size_t i = 0; i < total_sites; ++i)
+      init_link(c[i].link, Complx{0.0,0.0});
+    if (jit)
+      time[jit] = time_jit(iterations, [&]() {
+        kernel((const Real *)a.data(), (const Real *)b.data(), (Real *)c.data());
+      });
+    else
+      time[jit] = time_jit(iterations, [&]() {
+        k_mat_nn_chunked(a.data(), b.data(), c.data(), total_sites, chunk);
+      });
+    result = result && verify_mat_nn(a, b, c, total_sites);
+    printf("%10s %12.4f %12.3f %12.3f\n", jit ? "jit" : "generic", time[jit] / iterations * 1.0e3,
+           iterations * flops / time[jit] / 1.0e9, iterations * bytes / time[jit] / 1.0e9);
+  }
+  const double gain = (time[0] - time[1]) / iterations;
+  printf("JIT speedup = %.3f, compile %.3f ms, load %.3f ms\n", time[0] / time[1], tcompile * 1.0e3, tload * 1.0e3);
+  if (gain > 0.0)
+    printf("The compile pays off after %.0f iterations, a cache hit after %.0f\n",
+           std::ceil((tcompile + tload) / gain), std::ceil(tload / gain));
+  else
+    printf("The JIT kernel is not faster, the compile does not pay off\n");
+  dlclose(handle);
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _JIT_OPENMP2_HPP
@@ -0,0 +1,99 @@
+#ifndef _LATENCY_HPP
+#define _LATENCY_HPP
+// Launch latency mode
+// For small lattices the per-launch cost of the programming model dominates.
+// This mode sweeps LATENCY_MIN_LDIM^4 to LATENCY_MAX_LDIM^4 lattices and reports
+// the distribution of the synchronous per-launch latency, next to the per-launch
+// time when all iterations are submitted before a single fence or wait.
+// The backend supplies su3_mat_nn_latency(), which fills the per-launch samples
+// and returns the asynchronous submission time.
+#include <algorithm>
+
+#ifndef LATENCY_MIN_LDIM
+#  define LATENCY_MIN_LDIM 2
+#endif
+#ifndef LATENCY_MAX_LDIM
+#  define LATENCY_MAX_LDIM 12
+#endif
+
+// nearest rank percentile of a sorted sample
+static double percentile(const std::vector<double> &sorted, double p)
+{
+  size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[rank];
+}
+
+int run_latency(size_t iterations, size_t threads_per_group, int device, const std::string &csv_filename)
+{
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Latency mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  FILE *output = NULL;
+  if (csv_filename != "") {
+    output = fopen(csv_filename.c_str(), "w");
+    fprintf(output, "ldim,sites,min_us,p50_us,p90_us,p99_us,max_us,mean_us,async_us,overlap\n");
+  }
+  if (verbose >= 1) {
+    printf("Launch latency sweep over %d^4 to %d^4 sites\n", LATENCY_MIN_LDIM, LATENCY_MAX_LDIM);
+    printf("Executing %zu iterations with %zu warmups per lattice\n", iterations, warmups);
+    printf("%5s %8s %10s %10s %10s %10s %10s %10s %10s %8s\n", "ldim", "sites",
+           "min_us", "p50_us", "p90_us", "p99_us", "max_us", "mean_us", "async_us", "overlap");
+  }
+
+  const unsigned int saved_verbose = verbose;
+  bool result = true;
+  for (size_t ldim = LATENCY_MIN_LDIM; ldim <= LATENCY_MAX_LDIM; ++ldim) {
+    size_t total_sites = ldim*ldim*ldim*ldim;
+#ifdef USE_KOKKOS
+    h_site_view a("a", total_sites);
+    h_site_view c("c", total_sites);
+    h_su3_matrix_view b("b", 4);
+#else
+    std::vector<site> a(total_sites);
+    std::vector<su3_matrix> b(4);
+    std::vector<site> c(total_sites);
+#endif
+#ifdef USE_OPENMP_CPU
+    first_touch(a.data(), b.data(), c.data(), total_sites);
+#endif
+    make_lattice(a.data(), ldim, Complx{1.0,0.0});
+    init_link(b.data(), Complx{1.0/3.0,0.0});
+
+    // keep the backends quiet inside the sweep
+    std::vector<double> latency;
+    verbose = 0;
+    const double tasync = su3_mat_nn_latency(a, b, c, total_sites, iterations, threads_per_group, device, latency);
+    verbose = saved_verbose;
+    result = result && verify_mat_nn(a, b, c, total_sites);
+
+    std::sort(latency.begin(), latency.end());
+    double mean = 0.0;
+    for (double t : latency)
+      mean += t;
+    mean /= latency.size();
+    const double async = tasync / iterations;
+    // ratio of the fenced to the asynchronous per-launch time, >1 when launches overlap
+    const double overlap = mean / async;
+
+    if (verbose >= 1)
+      printf("%5zu %8zu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %8.2f\n", ldim, total_sites,
+             latency.front()*1.0e6, percentile(latency, 50)*1.0e6, percentile(latency, 90)*1.0e6,
+             percentile(latency, 99)*1.0e6, latency.back()*1.0e6, mean*1.0e6, async*1.0e6, overlap);
+    if (output != NULL)
+      fprintf(output, "%zu,%zu,%f,%f,%f,%f,%f,%f,%f,%f\n", ldim, total_sites,
+              latency.front()*1.0e6, percentile(latency, 50)*1.0e6, percentile(latency, 90)*1.0e6,
+              percentile(latency, 99)*1.0e6, latency.back()*1.0e6, mean*1.0e6, async*1.0e6, overlap);
+  }
+  if (output != NULL)
+    fclose(output);
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _LATENCY_HPP
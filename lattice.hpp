@@ -32,6 +32,10 @@ typedef struct Site {
     Site() {}  // Use a no-op constructor to avoid NUMA initialization issues
                // The application is responsible for initialization
 #endif
+#ifdef __OPENCL_VERSION__
+} site __attribute__((aligned(16)));  // match the host side default alignment
+#else
 } site __attribute__((aligned));
+#endif
 
 #endif  // _LATTICE_HPP
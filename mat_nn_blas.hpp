@@ -0,0 +1,182 @@
+// CPU BLAS implementation
+// Maps C = A*B to batched complex GEMM, one 3x3 product per site and link,
+// with CGEMM for single and ZGEMM for double precision.  The batch is selected
+// with -p,
+//   strided  one strided batch per link direction, A and C stepping by the
+//            site struct and B by 0 (default when the site size is a multiple
+//            of the complex size)
+//   pointer  one batch of 4*sites pointer triples, built before the timing
+// With MKL (USE_MKL) these are cblas_?gemm_batch_strided and cblas_?gemm_batch,
+// one sub-batch per OpenMP thread with the sequential MKL.  Other BLAS
+// libraries, such as OpenBLAS, have no batched GEMM, so the batch is an OpenMP
+// loop of single cblas_?gemm calls with the BLAS threading off.
+#include <omp.h>
+#include <unistd.h>
+#ifdef USE_MKL
+  #include <mkl.h>
+#else
+  #include <cblas.h>
+#endif
+
+#if (PRECISION==1)
+  #define BLAS_GEMM               cblas_cgemm
+  #define BLAS_GEMM_BATCH         cblas_cgemm_batch
+  #define BLAS_GEMM_BATCH_STRIDED cblas_cgemm_batch_strided
+#else
+  #define BLAS_GEMM               cblas_zgemm
+  #define BLAS_GEMM_BATCH         cblas_zgemm_batch
+  #define BLAS_GEMM_BATCH_STRIDED cblas_zgemm_batch_strided
+#endif
+
+enum BlasBatch { BLAS_STRIDED, BLAS_POINTER };
+static const char *blas_batch_names[] = {"strided", "pointer"};
+
+// the sites hold whole complex numbers, so A and C have a strided layout
+static const bool blas_strided_layout = sizeof(site) % sizeof(Complx) == 0;
+
+static const Complx blas_one = {1.0, 0.0}, blas_zero = {0.0, 0.0};
+
+#ifdef USE_MKL
+// the [first, last) products of the calling thread, in static schedule order
+static inline void thread_range(size_t count, size_t &first, size_t &last)
+{
+  const size_t threads = omp_get_num_threads(), thread = omp_get_thread_num();
+  first = count * thread / threads;
+  last = count * (thread + 1) / threads;
+}
+#endif
+
+// count 3x3 products, A and C stepping by stride_ac and B by stride_b complex numbers
+static void gemm_batch_strided(const Complx *a, const Complx *b, Complx *c,
+                               size_t stride_ac, size_t stride_b, size_t count)
+{
+#ifdef USE_MKL
+  #pragma omp parallel
+  {
+    TRACE_ZONE("gemm chunk");
+    size_t first, last;
+    thread_range(count, first, last);
+    if (last > first)
+      BLAS_GEMM_BATCH_STRIDED(CblasRowMajor, CblasNoTrans, CblasNoTrans, 3, 3, 3, &blas_one,
+                              a + first*stride_ac, 3, stride_ac, b + first*stride_b, 3, stride_b,
+                              &blas_zero, c + first*stride_ac, 3, stride_ac, last - first);
+  }
+#else
+  #pragma omp parallel
+  {
+    TRACE_ZONE("gemm chunk");
+    #pragma omp for nowait
+    for (size_t i = 0; i < count; ++i)
+      BLAS_GEMM(CblasRowMajor, CblasNoTrans, CblasNoTrans, 3, 3, 3, &blas_one,
+                a + i*stride_ac, 3, b + i*stride_b, 3, &blas_zero, c + i*stride_ac, 3);
+  }
+#endif
+}
+
+// count 3x3 products through arrays of pointers
+static void gemm_batch_pointer(const Complx **a, const Complx **b, Complx **c, size_t count)
+{
+#ifdef USE_MKL
+  const CBLAS_TRANSPOSE trans = CblasNoTrans;
+  const MKL_INT dim = 3;
+  #pragma omp parallel
+  {
+    TRACE_ZONE("gemm chunk");
+    size_t first, last;
+    thread_range(count, first, last);
+    const MKL_INT group_size = last - first;
+    if (group_size > 0)
+      BLAS_GEMM_BATCH(CblasRowMajor, &trans, &trans, &dim, &dim, &dim, &blas_one,
+                      (const void **)(a + first), &dim, (const void **)(b + first), &dim, &blas_zero,
+                      (void **)(c + first), &dim, 1, &group_size);
+  }
+#else
+  #pragma omp parallel
+  {
+    TRACE_ZONE("gemm chunk");
+    #pragma omp for nowait
+    for (size_t i = 0; i < count; ++i)
+      BLAS_GEMM(CblasRowMajor, CblasNoTrans, CblasNoTrans, 3, 3, 3, &blas_one,
+                a[i], 3, b[i], 3, &blas_zero, c[i], 3);
+  }
+#endif
+}
+
+static void parse_blas_options(BlasBatch &batch) {
+  int opt;
+  optind = 1;
+  while ((opt=getopt(g_argc, g_argv, ":p:")) != -1) {
+    switch (opt) {
+    case 'p':
+      for (int v = BLAS_STRIDED; v <= BLAS_POINTER; ++v)
+        if (std::string(optarg) == blas_batch_names[v])
+          batch = (BlasBatch)v;
+      if (std::string(optarg) != blas_batch_names[batch]) {
+        fprintf(stderr, "ERROR: Unknown BLAS batch %s (strided|pointer)\n", optarg);
+        exit(1);
+      }
+      break;
+    }
+  }
+}
+
+double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c,
+		  size_t total_sites, size_t iterations, size_t threads_per_team, int use_device, Profile* profile)
+{
+  BlasBatch batch = blas_strided_layout ? BLAS_STRIDED : BLAS_POINTER;
+  parse_blas_options(batch);
+  if (batch == BLAS_STRIDED && !blas_strided_layout) {
+    fprintf(stderr, "ERROR: The site size is not a multiple of the complex size, use -p pointer\n");
+    exit(1);
+  }
+  // the products are spread over the OpenMP threads, each call runs serially
+#ifdef OPENBLAS_VERSION
+  openblas_set_num_threads(1);
+#endif
+#ifdef USE_MKL
+  mkl_set_num_threads(1);
+#endif
+  if (verbose > 0) {
+    std::cout << "Number of threads = " << omp_get_max_threads() << std::endl;
+    std::cout << "BLAS batch = " << blas_batch_names[batch] << std::endl;
+  }
+
+  // The lattices are shared with the host, there are no transfers
+  profile->host_to_device_time = 0.0;
+  profile->device_to_host_time = 0.0;
+
+  // the pointer arrays are set up once, outside the timing
+  const size_t total_links = 4*total_sites;
+  std::vector<const Complx *> pa, pb;
+  std::vector<Complx *> pc;
+  if (batch == BLAS_POINTER) {
+    pa.resize(total_links);
+    pb.resize(total_links);
+    pc.resize(total_links);
+    #pragma omp parallel for
+    for (size_t i = 0; i < total_sites; ++i)
+      for (int j = 0; j < 4; ++j) {
+        pa[4*i + j] = &a[i].link[j].e[0][0];
+        pb[4*i + j] = &b[j].e[0][0];
+        pc[4*i + j] = &c[i].link[j].e[0][0];
+      }
+  }
+
+  // benchmark loop
+  const size_t stride = sizeof(site) / sizeof(Complx);
+  auto tstart = Clock::now();
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    if (batch == BLAS_STRIDED) {
+      for (int j = 0; j < 4; ++j)
+        gemm_batch_strided(&a[0].link[j].e[0][0], &b[j].e[0][0], &c[0].link[j].e[0][0],
+                           stride, 0, total_sites);
+    } else {
+      gemm_batch_pointer(pa.data(), pb.data(), pc.data(), total_links);
+    }
+  }
+  profile->kernel_time = std::chrono::duration<double>(Clock::now()-tstart).count();
+  return profile->kernel_time;
+}
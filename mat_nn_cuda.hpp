@@ -17,10 +17,10 @@ __global__ void k_mat_nn(
   const site*       __restrict__ a,
   const su3_matrix* __restrict__ b,
         site*       __restrict__ c,
-  int               total_sites)
+  size_t            total_sites)
 {
-  int myThread = blockDim.x * blockIdx.x + threadIdx.x;
-  int mySite = myThread/36;
+  size_t myThread = (size_t)blockDim.x * blockIdx.x + threadIdx.x;
+  size_t mySite = myThread/36;
 
   if (mySite < total_sites) {
     int j = (myThread%36)/9;
@@ -40,10 +40,10 @@ __global__ void k_mat_nn(
 double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c, 
 		  size_t total_sites, size_t iterations, size_t threadsPerBlock, int use_device, Profile *profile)
 {
-  int blocksPerGrid;
-  int size_a = sizeof(site) * total_sites;
-  int size_b = sizeof(su3_matrix) * 4;
-  int size_c = sizeof(site) * total_sites;
+  size_t blocksPerGrid;
+  size_t size_a = sizeof(site) * total_sites;
+  size_t size_b = sizeof(su3_matrix) * 4;
+  size_t size_c = sizeof(site) * total_sites;
 
   if (threadsPerBlock == 0)
     threadsPerBlock = THREADS_PER_SITE;
@@ -96,15 +96,15 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
   blocksPerGrid = total_sites/sitesPerBlock + 0.999999;
 
   if (verbose >= 1) {
-    printf("Number of blocks set to %d\n", blocksPerGrid);
-    printf("Threads per block set to %d\n", threadsPerBlock);
+    printf("Number of blocks set to %zu\n", blocksPerGrid);
+    printf("Threads per block set to %zu\n", threadsPerBlock);
   }
 
   // benchmark loop
   auto tstart = Clock::now();
   tprofiling = tstart;
 
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
     if (iters == warmups) {
       cudaDeviceSynchronize();
       tstart = Clock::now();
@@ -1,5 +1,7 @@
 // Kokkos implementation
 #include <Kokkos_Core.hpp>
+#include <Kokkos_SIMD.hpp>
+#include <string>
 
 #define THREADS_PER_SITE 36
 #define NUM_TEAMS 1600
@@ -11,6 +13,80 @@ using d_su3_matrix_view = Kokkos::View<su3_matrix *, ExecSpace>;
 using h_site_view = Kokkos::View<site *, HostExecSpace>;
 using h_su3_matrix_view = Kokkos::View<su3_matrix *, HostExecSpace>;
 
+// Structure-of-arrays link field: site index is the stride-1 dimension,
+// followed by direction, row, column and real/imaginary part
+using d_link_soa_view = Kokkos::View<Real *[4][3][3][2], Kokkos::LayoutLeft, ExecSpace>;
+
+using simd_real = Kokkos::Experimental::native_simd<Real>;
+#if KOKKOS_VERSION >= 40200
+#define SIMD_FLAGS Kokkos::Experimental::simd_flag_default
+#else
+#define SIMD_FLAGS Kokkos::Experimental::element_aligned_tag()
+#endif
+
+// Kernel variants selectable with -p
+//   team    - 36 team threads per site, shaped for GPUs (LayoutRight only)
+//   range   - RangePolicy over sites, one site per iteration
+//   mdrange - MDRangePolicy over (site, link, row, column)
+//   simd    - RangePolicy over chunks of sites using Kokkos::Experimental::simd
+//             (LayoutLeft only)
+// Site layout selectable with -y
+//   right   - array of site structures, as allocated by the driver
+//   left    - structure-of-arrays link field, packed/unpacked around the kernel
+enum KokkosVariant { K_TEAM, K_RANGE, K_MDRANGE, K_SIMD };
+enum KokkosLayout { K_RIGHT, K_LEFT };
+
+static const char *variant_names[] = {"team", "range", "mdrange", "simd"};
+static const char *layout_names[] = {"right", "left"};
+
+// When set, time_kernel() records the per-launch latencies into latency_samples
+// and the time to submit all iterations before a single fence into latency_async
+static std::vector<double> *latency_samples = nullptr;
+static double latency_async = 0.0;
+
+// Runs the timed iteration loop for any policy/kernel pair
+template <class Policy, class Kernel>
+double time_kernel(const char *name, const Policy &policy, const Kernel &kernel,
+                   size_t iterations, Profile *profile) {
+    if (latency_samples != nullptr) {
+        for (size_t iters = 0; iters < warmups; ++iters)
+            Kokkos::parallel_for(name, policy, kernel);
+        Kokkos::fence();
+
+        latency_samples->resize(iterations);
+        for (size_t iters = 0; iters < iterations; ++iters) {
+            Kokkos::Timer launch;
+            Kokkos::parallel_for(name, policy, kernel);
+            Kokkos::fence();
+            (*latency_samples)[iters] = launch.seconds();
+        }
+
+        Kokkos::Timer async;
+        for (size_t iters = 0; iters < iterations; ++iters)
+            Kokkos::parallel_for(name, policy, kernel);
+        Kokkos::fence();
+        latency_async = async.seconds();
+        profile->kernel_time = latency_async;
+        return latency_async;
+    }
+
+    Kokkos::Timer start;
+    auto tprofiling = Clock::now();
+    for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+        TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+        if (iters == warmups) {
+            Kokkos::fence();
+            start.reset();
+            tprofiling = Clock::now();
+        }
+        Kokkos::parallel_for(name, policy, kernel);
+        Kokkos::fence();
+    }
+
+    profile->kernel_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+    return (start.seconds());
+}
+
 //
 //*******************  m_mat_nn.c  (in su3.a) ****************************
 //  void mult_su3_nn( su3_matrix *a,*b,*c )
@@ -18,7 +94,7 @@ using h_su3_matrix_view = Kokkos::View<su3_matrix *, HostExecSpace>;
 //  C  <-  A*B
 
 double k_mat_nn(size_t iterations, d_site_view a, d_su3_matrix_view b,
-                d_site_view c, int total_sites, int blocksPerGrid,
+                d_site_view c, size_t total_sites, size_t blocksPerGrid,
                 int threadsPerBlock, Profile* profile) {
     using team_policy =
         Kokkos::TeamPolicy<ExecSpace,
@@ -26,67 +102,447 @@ double k_mat_nn(size_t iterations, d_site_view a, d_su3_matrix_view b,
     using member_type = team_policy::member_type;
     team_policy policy(blocksPerGrid, threadsPerBlock);
 
-    Kokkos::Timer start;
-    auto tprofiling = Clock::now();
-    for (size_t iters = 0; iters < iterations + warmups; ++iters) {
-        if (iters == warmups) {
-            Kokkos::fence();
-            start.reset();
-            tprofiling = Clock::now();
-        }
-        Kokkos::parallel_for(
-            "k_mat_nn", policy, KOKKOS_LAMBDA(const member_type &team) {
-                int myThread =
-                    team.team_size() * team.league_rank() + team.team_rank();
-                int mySite = myThread / 36;
-                if (mySite < total_sites) {
-                    int j = (myThread % 36) / 9;
-                    int k = (myThread % 9) / 3;
-                    int l = myThread % 3;
-                    Complx cc = {0.0, 0.0};
-                    for (int m = 0; m < 3; m++)
-                        cc += a(mySite).link[j].e[k][m] * b(j).e[m][l];
-
-                    c(mySite).link[j].e[k][l] = cc;
-                }
-            });
-        Kokkos::fence();
+    return time_kernel(
+        "k_mat_nn", policy, KOKKOS_LAMBDA(const member_type &team) {
+            size_t myThread =
+                (size_t)team.team_size() * team.league_rank() + team.team_rank();
+            size_t mySite = myThread / 36;
+            if (mySite < total_sites) {
+                int j = (myThread % 36) / 9;
+                int k = (myThread % 9) / 3;
+                int l = myThread % 3;
+                Complx cc = {0.0, 0.0};
+                for (int m = 0; m < 3; m++)
+                    cc += a(mySite).link[j].e[k][m] * b(j).e[m][l];
+
+                c(mySite).link[j].e[k][l] = cc;
+            }
+        }, iterations, profile);
+}
+
+// One site per work item, array of site structures
+double k_mat_nn_range(size_t iterations, d_site_view a, d_su3_matrix_view b,
+                      d_site_view c, size_t total_sites, Profile* profile) {
+    Kokkos::RangePolicy<ExecSpace, Kokkos::IndexType<size_t>> policy(0, total_sites);
+
+    return time_kernel(
+        "k_mat_nn_range", policy, KOKKOS_LAMBDA(const size_t i) {
+            for (int j = 0; j < 4; j++)
+                for (int k = 0; k < 3; k++)
+                    for (int l = 0; l < 3; l++) {
+                        Complx cc = {0.0, 0.0};
+                        for (int m = 0; m < 3; m++)
+                            cc += a(i).link[j].e[k][m] * b(j).e[m][l];
+                        c(i).link[j].e[k][l] = cc;
+                    }
+        }, iterations, profile);
+}
+
+// The other members of the mult_su3 family, one site per work item
+template <MultVariant V>
+double k_mult_su3_range(size_t iterations, d_site_view a, d_su3_matrix_view b,
+                        d_site_view c, size_t total_sites, Profile* profile) {
+    Kokkos::RangePolicy<ExecSpace, Kokkos::IndexType<size_t>> policy(0, total_sites);
+
+    return time_kernel(
+        "k_mult_su3_range", policy, KOKKOS_LAMBDA(const size_t i) {
+            for (int j = 0; j < 4; j++)
+                mult_su3<V>(&a(i).link[j], &b(j), &c(i).link[j]);
+        }, iterations, profile);
+}
+
+double k_mult_su3_range(MultVariant v, size_t iterations, d_site_view a, d_su3_matrix_view b,
+                        d_site_view c, size_t total_sites, Profile* profile) {
+    switch (v) {
+    case MULT_NA:
+        return k_mult_su3_range<MULT_NA>(iterations, a, b, c, total_sites, profile);
+    case MULT_AN:
+        return k_mult_su3_range<MULT_AN>(iterations, a, b, c, total_sites, profile);
+    case MULT_NN_ACC:
+        return k_mult_su3_range<MULT_NN_ACC>(iterations, a, b, c, total_sites, profile);
+    case MULT_NN_AXPY:
+        return k_mult_su3_range<MULT_NN_AXPY>(iterations, a, b, c, total_sites, profile);
+    default:
+        return k_mat_nn_range(iterations, a, b, c, total_sites, profile);
     }
+}
 
-    profile->kernel_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
-    return (start.seconds());
+// One site per work item, bare output link field
+double k_mat_nn_range_lean(size_t iterations, d_site_view a, d_su3_matrix_view b,
+                           d_su3_matrix_view c, size_t total_sites, Profile* profile) {
+    Kokkos::RangePolicy<ExecSpace, Kokkos::IndexType<size_t>> policy(0, total_sites);
+
+    return time_kernel(
+        "k_mat_nn_range_lean", policy, KOKKOS_LAMBDA(const size_t i) {
+            for (int j = 0; j < 4; j++)
+                for (int k = 0; k < 3; k++)
+                    for (int l = 0; l < 3; l++) {
+                        Complx cc = {0.0, 0.0};
+                        for (int m = 0; m < 3; m++)
+                            cc += a(i).link[j].e[k][m] * b(j).e[m][l];
+                        c(4 * i + j).e[k][l] = cc;
+                    }
+        }, iterations, profile);
+}
+
+// One site per work item, A = A*B formed in per-site temporaries
+double k_mat_nn_range_inplace(size_t iterations, d_site_view a, d_su3_matrix_view b,
+                              size_t total_sites, Profile* profile) {
+    Kokkos::RangePolicy<ExecSpace, Kokkos::IndexType<size_t>> policy(0, total_sites);
+
+    return time_kernel(
+        "k_mat_nn_range_inplace", policy, KOKKOS_LAMBDA(const size_t i) {
+            su3_matrix tmp[4];
+            for (int j = 0; j < 4; j++)
+                for (int k = 0; k < 3; k++)
+                    for (int l = 0; l < 3; l++) {
+                        Complx cc = {0.0, 0.0};
+                        for (int m = 0; m < 3; m++)
+                            cc += a(i).link[j].e[k][m] * b(j).e[m][l];
+                        tmp[j].e[k][l] = cc;
+                    }
+            for (int j = 0; j < 4; j++)
+                a(i).link[j] = tmp[j];
+        }, iterations, profile);
+}
+
+// One matrix element per work item, array of site structures
+double k_mat_nn_mdrange(size_t iterations, d_site_view a, d_su3_matrix_view b,
+                        d_site_view c, size_t total_sites, Profile* profile) {
+    Kokkos::MDRangePolicy<ExecSpace, Kokkos::Rank<4>, Kokkos::IndexType<int64_t>>
+        policy({0, 0, 0, 0}, {(int64_t)total_sites, 4, 3, 3});
+
+    return time_kernel(
+        "k_mat_nn_mdrange", policy,
+        KOKKOS_LAMBDA(const int64_t i, const int64_t j, const int64_t k, const int64_t l) {
+            Complx cc = {0.0, 0.0};
+            for (int m = 0; m < 3; m++)
+                cc += a(i).link[j].e[k][m] * b(j).e[m][l];
+            c(i).link[j].e[k][l] = cc;
+        }, iterations, profile);
+}
+
+// One site per work item, structure-of-arrays link field
+double k_mat_nn_range_soa(size_t iterations, d_link_soa_view a, d_su3_matrix_view b,
+                          d_link_soa_view c, size_t total_sites, Profile* profile) {
+    Kokkos::RangePolicy<ExecSpace, Kokkos::IndexType<size_t>> policy(0, total_sites);
+
+    return time_kernel(
+        "k_mat_nn_range_soa", policy, KOKKOS_LAMBDA(const size_t i) {
+            for (int j = 0; j < 4; j++)
+                for (int k = 0; k < 3; k++)
+                    for (int l = 0; l < 3; l++) {
+                        Real cr = 0.0, ci = 0.0;
+                        for (int m = 0; m < 3; m++) {
+                            const Real ar = a(i, j, k, m, 0);
+                            const Real ai = a(i, j, k, m, 1);
+                            const Complx bb = b(j).e[m][l];
+                            cr += ar * bb.real() - ai * bb.imag();
+                            ci += ar * bb.imag() + ai * bb.real();
+                        }
+                        c(i, j, k, l, 0) = cr;
+                        c(i, j, k, l, 1) = ci;
+                    }
+        }, iterations, profile);
+}
+
+// One matrix element per work item, structure-of-arrays link field
+// The site index is iterated fastest to match the stride-1 dimension
+double k_mat_nn_mdrange_soa(size_t iterations, d_link_soa_view a, d_su3_matrix_view b,
+                            d_link_soa_view c, size_t total_sites, Profile* profile) {
+    Kokkos::MDRangePolicy<ExecSpace,
+                          Kokkos::Rank<4, Kokkos::Iterate::Left, Kokkos::Iterate::Left>,
+                          Kokkos::IndexType<int64_t>>
+        policy({0, 0, 0, 0}, {(int64_t)total_sites, 4, 3, 3});
+
+    return time_kernel(
+        "k_mat_nn_mdrange_soa", policy,
+        KOKKOS_LAMBDA(const int64_t i, const int64_t j, const int64_t k, const int64_t l) {
+            Real cr = 0.0, ci = 0.0;
+            for (int m = 0; m < 3; m++) {
+                const Real ar = a(i, j, k, m, 0);
+                const Real ai = a(i, j, k, m, 1);
+                const Complx bb = b(j).e[m][l];
+                cr += ar * bb.real() - ai * bb.imag();
+                ci += ar * bb.imag() + ai * bb.real();
+            }
+            c(i, j, k, l, 0) = cr;
+            c(i, j, k, l, 1) = ci;
+        }, iterations, profile);
+}
+
+// simd_real::size() consecutive sites per work item, structure-of-arrays link field
+// The remainder sites that do not fill a whole vector are handled with scalar code
+double k_mat_nn_simd(size_t iterations, d_link_soa_view a, d_su3_matrix_view b,
+                     d_link_soa_view c, size_t total_sites, Profile* profile) {
+    const int width = simd_real::size();
+    const size_t chunks = (total_sites + width - 1) / width;
+    Kokkos::RangePolicy<ExecSpace, Kokkos::IndexType<size_t>> policy(0, chunks);
+
+    return time_kernel(
+        "k_mat_nn_simd", policy, KOKKOS_LAMBDA(const size_t chunk) {
+            const size_t base = chunk * width;
+            if (base + width <= total_sites) {
+                for (int j = 0; j < 4; j++)
+                    for (int k = 0; k < 3; k++)
+                        for (int l = 0; l < 3; l++) {
+                            simd_real cr(0.0), ci(0.0), ar, ai;
+                            for (int m = 0; m < 3; m++) {
+                                ar.copy_from(&a(base, j, k, m, 0), SIMD_FLAGS);
+                                ai.copy_from(&a(base, j, k, m, 1), SIMD_FLAGS);
+                                const simd_real br(b(j).e[m][l].real());
+                                const simd_real bi(b(j).e[m][l].imag());
+                                cr += ar * br - ai * bi;
+                                ci += ar * bi + ai * br;
+                            }
+                            cr.copy_to(&c(base, j, k, l, 0), SIMD_FLAGS);
+                            ci.copy_to(&c(base, j, k, l, 1), SIMD_FLAGS);
+                        }
+            } else {
+                for (size_t i = base; i < total_sites; i++)
+                    for (int j = 0; j < 4; j++)
+                        for (int k = 0; k < 3; k++)
+                            for (int l = 0; l < 3; l++) {
+                                Real cr = 0.0, ci = 0.0;
+                                for (int m = 0; m < 3; m++) {
+                                    const Complx bb = b(j).e[m][l];
+                                    cr += a(i, j, k, m, 0) * bb.real() - a(i, j, k, m, 1) * bb.imag();
+                                    ci += a(i, j, k, m, 0) * bb.imag() + a(i, j, k, m, 1) * bb.real();
+                                }
+                                c(i, j, k, l, 0) = cr;
+                                c(i, j, k, l, 1) = ci;
+                            }
+            }
+        }, iterations, profile);
+}
+
+// Parses the Kokkos specific -p (variant) and -y (layout) options
+static void parse_kokkos_options(KokkosVariant &variant, KokkosLayout &layout) {
+    int opt;
+    optind = 1;
+    while ((opt = getopt(g_argc, g_argv, ":p:y:")) != -1) {
+        switch (opt) {
+        case 'p':
+            for (int v = K_TEAM; v <= K_SIMD; v++)
+                if (std::string(optarg) == variant_names[v]) variant = (KokkosVariant)v;
+            if (std::string(optarg) != variant_names[variant]) {
+                fprintf(stderr, "ERROR: Unknown Kokkos variant %s (team|range|mdrange|simd)\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'y':
+            for (int l = K_RIGHT; l <= K_LEFT; l++)
+                if (std::string(optarg) == layout_names[l]) layout = (KokkosLayout)l;
+            if (std::string(optarg) != layout_names[layout]) {
+                fprintf(stderr, "ERROR: Unknown Kokkos layout %s (right|left)\n", optarg);
+                exit(1);
+            }
+            break;
+        }
+    }
 }
 
 double su3_mat_nn(h_site_view &a, h_su3_matrix_view &b, h_site_view &c,
                   size_t total_sites, size_t iterations, size_t threadsPerBlock,
                   int use_device, Profile* profile) {
+    // GPU execution spaces default to the team kernel, host spaces to one site per iteration
+    constexpr bool host_space =
+        Kokkos::SpaceAccessibility<Kokkos::HostSpace, ExecSpace::memory_space>::accessible;
+    KokkosVariant variant = host_space ? K_RANGE : K_TEAM;
+    KokkosLayout layout = K_RIGHT;
+    parse_kokkos_options(variant, layout);
+    if (variant == K_SIMD) layout = K_LEFT;
+    if (variant == K_TEAM && layout == K_LEFT) {
+        fprintf(stderr, "ERROR: The team variant requires the right layout\n");
+        exit(1);
+    }
+    if (mult_variant != MULT_NN && (variant != K_RANGE || layout != K_RIGHT)) {
+        fprintf(stderr, "ERROR: The %s kernel requires the range variant and right layout\n",
+                mult_names[mult_variant]);
+        exit(1);
+    }
+
     if (threadsPerBlock == 0) threadsPerBlock = THREADS_PER_SITE;
     double sitesPerBlock = (double)threadsPerBlock / THREADS_PER_SITE;
-    int blocksPerGrid = total_sites / sitesPerBlock + 0.999999;
+    size_t blocksPerGrid = total_sites / sitesPerBlock + 0.999999;
 
     if (verbose >= 1) {
-        printf("Number of blocks set to %d\n", blocksPerGrid);
-        printf("Threads per block set to %zu\n", threadsPerBlock);
+        printf("Kernel variant set to %s\n", variant_names[variant]);
+        printf("Site layout set to %s\n", layout_names[layout]);
+        if (variant == K_TEAM) {
+            printf("Number of blocks set to %zu\n", blocksPerGrid);
+            printf("Threads per block set to %zu\n", threadsPerBlock);
+        }
+        if (variant == K_SIMD)
+            printf("SIMD width set to %d\n", (int)simd_real::size());
         printf("Device number set to %d\n", use_device);
     }
 
+    double ttotal;
     auto tprofiling = Clock::now();
+    int64_t ttrace = trace_now();
 
-    d_site_view d_a(Kokkos::ViewAllocateWithoutInitializing("d_a"), total_sites);
-    d_site_view d_c(Kokkos::ViewAllocateWithoutInitializing("d_c"), total_sites);
     d_su3_matrix_view d_b(Kokkos::ViewAllocateWithoutInitializing("d_b"), 4);
+    Kokkos::deep_copy(d_b, b);
+
+    if (layout == K_RIGHT) {
+        d_site_view d_a(Kokkos::ViewAllocateWithoutInitializing("d_a"), total_sites);
+        d_site_view d_c(Kokkos::ViewAllocateWithoutInitializing("d_c"), total_sites);
+
+        Kokkos::deep_copy(d_a, a);
+        // the accumulating kernels read C, which starts from zero
+        if (mult_variant == MULT_NN_ACC || mult_variant == MULT_NN_AXPY)
+            Kokkos::deep_copy(d_c, site{});
+
+        profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+        trace_record("host_to_device", ttrace);
+
+        switch (variant) {
+        case K_RANGE:
+            ttotal = k_mult_su3_range(mult_variant, iterations, d_a, d_b, d_c, total_sites, profile);
+            break;
+        case K_MDRANGE:
+            ttotal = k_mat_nn_mdrange(iterations, d_a, d_b, d_c, total_sites, profile);
+            break;
+        default:
+            ttotal = k_mat_nn(iterations, d_a, d_b, d_c, total_sites,
+                              blocksPerGrid, threadsPerBlock, profile);
+        }
+
+        tprofiling = Clock::now();
+        ttrace = trace_now();
+        Kokkos::deep_copy(c, d_c);
+        profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+        trace_record("device_to_host", ttrace);
+    } else {
+        d_link_soa_view d_a(Kokkos::ViewAllocateWithoutInitializing("d_a"), total_sites);
+        d_link_soa_view d_c(Kokkos::ViewAllocateWithoutInitializing("d_c"), total_sites);
+
+        // The packing of A into the link field is accounted as host to device time
+        auto h_a = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, d_a);
+        Kokkos::parallel_for(
+            "pack_soa", Kokkos::RangePolicy<HostExecSpace>(0, total_sites), [=](const size_t i) {
+                for (int j = 0; j < 4; j++)
+                    for (int k = 0; k < 3; k++)
+                        for (int l = 0; l < 3; l++) {
+                            h_a(i, j, k, l, 0) = a(i).link[j].e[k][l].real();
+                            h_a(i, j, k, l, 1) = a(i).link[j].e[k][l].imag();
+                        }
+            });
+        Kokkos::deep_copy(d_a, h_a);
+
+        profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+        trace_record("host_to_device", ttrace);
+
+        switch (variant) {
+        case K_MDRANGE:
+            ttotal = k_mat_nn_mdrange_soa(iterations, d_a, d_b, d_c, total_sites, profile);
+            break;
+        case K_SIMD:
+            ttotal = k_mat_nn_simd(iterations, d_a, d_b, d_c, total_sites, profile);
+            break;
+        default:
+            ttotal = k_mat_nn_range_soa(iterations, d_a, d_b, d_c, total_sites, profile);
+        }
+
+        // The unpacking of C from the link field is accounted as device to host time
+        tprofiling = Clock::now();
+        ttrace = trace_now();
+        auto h_c = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, d_c);
+        Kokkos::deep_copy(h_c, d_c);
+        Kokkos::parallel_for(
+            "unpack_soa", Kokkos::RangePolicy<HostExecSpace>(0, total_sites), [=](const size_t i) {
+                for (int j = 0; j < 4; j++)
+                    for (int k = 0; k < 3; k++)
+                        for (int l = 0; l < 3; l++)
+                            c(i).link[j].e[k][l] = Complx(h_c(i, j, k, l, 0), h_c(i, j, k, l, 1));
+            });
+        Kokkos::fence();
+        profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+        trace_record("device_to_host", ttrace);
+    }
+
+    return ttotal;
+}
 
+// The lean and in-place outputs are provided by the range variant on the right layout
+static void require_range_variant(const char *output) {
+    KokkosVariant variant = K_RANGE;
+    KokkosLayout layout = K_RIGHT;
+    parse_kokkos_options(variant, layout);
+    if (variant != K_RANGE || layout != K_RIGHT) {
+        fprintf(stderr, "ERROR: The %s output requires the range variant and right layout\n", output);
+        exit(1);
+    }
+    if (verbose >= 1) {
+        printf("Kernel variant set to %s\n", variant_names[variant]);
+        printf("Site layout set to %s\n", layout_names[layout]);
+    }
+}
+
+// C = A*B with C a bare link field
+double su3_mat_nn(h_site_view &a, h_su3_matrix_view &b, h_su3_matrix_view &c,
+                  size_t total_sites, size_t iterations, size_t threadsPerBlock,
+                  int use_device, Profile* profile) {
+    require_range_variant("lean");
+
+    // host execution spaces work on the host views directly
+    auto tprofiling = Clock::now();
+    int64_t ttrace = trace_now();
+    d_site_view d_a = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, ExecSpace::memory_space(), a);
+    d_su3_matrix_view d_b = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, ExecSpace::memory_space(), b);
+    d_su3_matrix_view d_c = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, ExecSpace::memory_space(), c);
     Kokkos::deep_copy(d_a, a);
     Kokkos::deep_copy(d_b, b);
-
     profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+    trace_record("host_to_device", ttrace);
 
-    double ttotal = k_mat_nn(iterations, d_a, d_b, d_c, total_sites,
-			     blocksPerGrid, threadsPerBlock, profile);
+    double ttotal = k_mat_nn_range_lean(iterations, d_a, d_b, d_c, total_sites, profile);
 
     tprofiling = Clock::now();
+    ttrace = trace_now();
     Kokkos::deep_copy(c, d_c);
     profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+    trace_record("device_to_host", ttrace);
 
     return ttotal;
 }
+
+// A = A*B
+double su3_mat_nn_inplace(h_site_view &a, h_su3_matrix_view &b,
+                          size_t total_sites, size_t iterations, size_t threadsPerBlock,
+                          int use_device, Profile* profile) {
+    require_range_variant("in-place");
+
+    // host execution spaces update the host view directly
+    auto tprofiling = Clock::now();
+    int64_t ttrace = trace_now();
+    d_site_view d_a = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, ExecSpace::memory_space(), a);
+    d_su3_matrix_view d_b = Kokkos::create_mirror_view(Kokkos::WithoutInitializing, ExecSpace::memory_space(), b);
+    Kokkos::deep_copy(d_a, a);
+    Kokkos::deep_copy(d_b, b);
+    profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+    trace_record("host_to_device", ttrace);
+
+    double ttotal = k_mat_nn_range_inplace(iterations, d_a, d_b, total_sites, profile);
+
+    tprofiling = Clock::now();
+    ttrace = trace_now();
+    Kokkos::deep_copy(a, d_a);
+    profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+    trace_record("device_to_host", ttrace);
+
+    return ttotal;
+}
+
+// Launch latency measurement, returns the time to submit all iterations before
+// a single fence and fills latency with the time of each fenced launch
+double su3_mat_nn_latency(h_site_view &a, h_su3_matrix_view &b, h_site_view &c,
+                          size_t total_sites, size_t iterations, size_t threadsPerBlock,
+                          int use_device, std::vector<double> &latency) {
+    Profile profile;
+    latency_samples = &latency;
+    su3_mat_nn(a, b, c, total_sites, iterations, threadsPerBlock, use_device, &profile);
+    latency_samples = nullptr;
+    return latency_async;
+}
@@ -11,22 +11,25 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
   d_c = c.data(); len_c = c.size();
 
   auto tprofiling = Clock::now();
+  int64_t ttrace = trace_now();
 
   // Move A, B and C vectors to the device
   #pragma acc enter data copyin(d_a[0:len_a], d_b[0:len_b], d_c[0:len_c])
 
   profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("host_to_device", ttrace);
 
   // benchmark loop
   auto tstart = Clock::now();
   tprofiling = tstart;
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
       tstart = Clock::now();
       tprofiling = tstart;
     }
     #pragma acc parallel loop collapse(4) present(d_a[0:len_a], d_b[0:len_b], d_c[0:len_c])
-    for(int i=0;i<total_sites;++i) {
+    for(size_t i=0;i<total_sites;++i) {
       for (int j=0; j<4; ++j) {
         for(int k=0;k<3;k++) {
           for(int l=0;l<3;l++){
@@ -54,8 +57,10 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
 
   // move the result back
   tprofiling = Clock::now();
+  ttrace = trace_now();
   #pragma acc exit data copyout(d_c[0:len_c])
   profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("device_to_host", ttrace);
 
   return (ttotal /= 1.0e6);
 }
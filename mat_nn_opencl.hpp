@@ -1,15 +1,39 @@
 // OpenCL implementation
 // Preferably use the Khronos CL/cl2.hpp C++ definitions
-#define CL_HPP_TARGET_OPENCL_VERSION 120 
+#define CL_HPP_TARGET_OPENCL_VERSION 120
 #define CL_HPP_MINIMUM_OPENCL_VERSION 120
 #define CL_TARGET_OPENCL_VERSION 120
 #include <CL/cl2.hpp>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <set>
 
 #ifndef DEVICE
 #  define DEVICE CL_DEVICE_TYPE_ALL
 #endif
 
 #define THREADS_PER_SITE 36
+#define THREADS_PER_SITE_VEC4 18
+
+#ifndef CL_CACHE_DIR
+#  define CL_CACHE_DIR "su3_cl_cache"
+#endif
+#ifndef CL_INCLUDE_DIR
+#  define CL_INCLUDE_DIR "."  // where the kernel finds lattice.hpp
+#endif
+
+// Kernel builds selectable with -p
+//   generic - only the precision is fixed at build time
+//   spec    - the lattice size and workgroup size are also compile time constants
+//   vec2    - spec, with each complex value handled as a 2-wide vector
+//   vec4    - spec, with pairs of complex values from links j and j+2 handled
+//             as 4-wide vectors, 18 work items per site
+enum OpenCLBuild { CL_GENERIC, CL_SPEC, CL_VEC2, CL_VEC4 };
+static const char *build_names[] = {"generic", "spec", "vec2", "vec4"};
 
 //*******************  m_mat_nn.c  (in su3.a) ****************************
 //  void mult_su3_nn( su3_matrix *a,*b,*c )
@@ -17,30 +41,186 @@
 //  C  <-  A*B
 static const char kernel_src[] =
 "#include <lattice.hpp>\n"
+"#if (PRECISION == 1)\n"
+"typedef float2 real2;\n"
+"typedef float4 real4;\n"
+"#else\n"
+"typedef double2 real2;\n"
+"typedef double4 real4;\n"
+"#endif\n"
+"#ifdef TOTAL_SITES\n"
+"#define NSITES TOTAL_SITES\n"
+"#else\n"
+"#define NSITES total_sites\n"
+"#endif\n"
+"#ifdef WG_SIZE\n"
+"__attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))\n"
+"#endif\n"
 "__kernel void k_mat_nn(\n"
 "  __global const site*       restrict a,\n"
 "  __global const su3_matrix* restrict b,\n"
 "  __global       site*       restrict c,\n"
-"           const int         total_sites)\n"
+"           const ulong       total_sites)\n"
 "{\n"
-"  int myThread = get_global_id(0);\n"
-"  int mySite = myThread/36;\n"
-"  if (mySite < total_sites) {\n"
+"  size_t myThread = get_global_id(0);\n"
+"#if VEC == 4\n"
+"  size_t mySite = myThread/18;\n"
+"  if (mySite < NSITES) {\n"
+"    int j = (myThread%18)/9;\n"
+"    int k = (myThread%9)/3;\n"
+"    int l = myThread%3;\n"
+"    __global const real2 *a0 = (__global const real2 *)a[mySite].link[j].e[k];\n"
+"    __global const real2 *a1 = (__global const real2 *)a[mySite].link[j+2].e[k];\n"
+"    __global const real2 *b0 = (__global const real2 *)b[j].e[0];\n"
+"    __global const real2 *b1 = (__global const real2 *)b[j+2].e[0];\n"
+"    real4 cc = (real4)(0.0);\n"
+"    for (int m=0;m<3;m++) {\n"
+"      real4 x = (real4)(a0[m], a1[m]);\n"
+"      real4 y = (real4)(b0[3*m+l], b1[3*m+l]);\n"
+"      cc += x.xxzz * y + x.yyww * (real4)(-y.y, y.x, -y.w, y.z);\n"
+"    }\n"
+"    ((__global real2 *)c[mySite].link[j].e[k])[l] = cc.xy;\n"
+"    ((__global real2 *)c[mySite].link[j+2].e[k])[l] = cc.zw;\n"
+"  }\n"
+"#else\n"
+"  size_t mySite = myThread/36;\n"
+"  if (mySite < NSITES) {\n"
 "    int j = (myThread%36)/9;\n"
 "    int k = (myThread%9)/3;\n"
 "    int l = myThread%3;\n"
+"#if VEC == 2\n"
+"    __global const real2 *aa = (__global const real2 *)a[mySite].link[j].e[k];\n"
+"    __global const real2 *bb = (__global const real2 *)b[j].e[0];\n"
+"    real2 cc = (real2)(0.0);\n"
+"    for (int m=0;m<3;m++) {\n"
+"      real2 x = aa[m];\n"
+"      real2 y = bb[3*m+l];\n"
+"      cc += x.xx * y + x.yy * (real2)(-y.y, y.x);\n"
+"    }\n"
+"    ((__global real2 *)c[mySite].link[j].e[k])[l] = cc;\n"
+"#else\n"
 "    Complx cc = {0.0, 0.0};\n"
 "    for (int m=0;m<3;m++)\n"
 "      CMULSUM(a[mySite].link[j].e[k][m], b[j].e[m][l], cc);\n"
 "    c[mySite].link[j].e[k][l].real = cc.real;\n"
 "    c[mySite].link[j].e[k][l].imag = cc.imag;\n"
+"#endif\n"
 "  }\n"
+"#endif\n"
 "}\n";
 
+// Appends the text of a header, and of the headers it includes that are found
+// in dir, so a change to any of them changes the cache key
+static void header_text(const std::string &dir, const std::string &name, std::set<std::string> &seen,
+                        std::string &text)
+{
+  if (!seen.insert(name).second)
+    return;
+  std::ifstream in(dir + "/" + name);
+  std::string line;
+  while (std::getline(in, line)) {
+    text += line + '\n';
+    const size_t include = line.find("#include");
+    if (include == std::string::npos)
+      continue;
+    const size_t open = line.find_first_of("<\"", include);
+    const size_t close = open == std::string::npos ? open : line.find_first_of(">\"", open + 1);
+    if (close != std::string::npos)
+      header_text(dir, line.substr(open + 1, close - open - 1), seen, text);
+  }
+}
+
+// Builds the kernel program, going through the on-disk binary cache when enabled
+// The cache is keyed by the device, driver version, build options, kernel source
+// and the headers it includes
+static cl::Program build_program(cl::Context &context, cl::Device &device, const std::string &include_dir,
+                                 const std::string &build_args, const std::string &cache_dir, Profile *profile)
+{
+  std::string name, driver, headers;
+  device.getInfo(CL_DEVICE_NAME, &name);
+  device.getInfo(CL_DRIVER_VERSION, &driver);
+  std::set<std::string> seen;
+  header_text(include_dir, "lattice.hpp", seen, headers);
+  std::ostringstream key;
+  key << std::hex << std::hash<std::string>{}(name + '\n' + driver + '\n' + build_args + '\n' + kernel_src
+                                              + '\n' + headers);
+  const std::string cache_file = cache_dir + "/k_mat_nn_" + key.str() + ".bin";
+  profile->build_time = profile->load_time = 0.0;
+
+  // try the cache first
+  if (cache_dir != "none") {
+    auto tload = Clock::now();
+    std::ifstream in(cache_file, std::ios::binary);
+    if (in) {
+      std::vector<unsigned char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      cl_int err;
+      std::vector<cl_int> status;
+      cl::Program program(context, {device}, cl::Program::Binaries{binary}, &status, &err);
+      if (err == CL_SUCCESS && program.build(build_args.c_str()) == CL_SUCCESS) {
+        profile->load_time = std::chrono::duration<double>(Clock::now()-tload).count();
+        if (verbose >= 1)
+          printf("Program cache hit %s, load time = %f ms\n", cache_file.c_str(), profile->load_time*1000);
+        return program;
+      }
+      if (verbose >= 1)
+        printf("Program cache entry %s is stale, rebuilding\n", cache_file.c_str());
+    }
+  }
+
+  // build from source
+  auto tbuild = Clock::now();
+  cl::Program program(context, std::string(kernel_src));
+  if (program.build(build_args.c_str()) != CL_SUCCESS) {
+    std::cout << "ERROR: OpenCL kernel failed to build" << std::endl;
+    if (verbose >= 2)
+      std::cout << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+    exit(1);
+  }
+  profile->build_time = std::chrono::duration<double>(Clock::now()-tbuild).count();
+  if (verbose >= 1)
+    printf("Program compile time = %f ms\n", profile->build_time*1000);
+
+  // store the binary for the next run
+  if (cache_dir != "none") {
+    std::vector<std::vector<unsigned char>> binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+    mkdir(cache_dir.c_str(), 0755);
+    std::ofstream out(cache_file, std::ios::binary);
+    if (out && binaries.size() > 0 && binaries[0].size() > 0) {
+      out.write((const char *)binaries[0].data(), binaries[0].size());
+      if (verbose >= 2)
+        std::cout << "Program binary cached in " << cache_file << std::endl;
+    }
+  }
+  return program;
+}
+
 // OpenCL implementation of su3_mat_nn()
-double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c, 
-              size_t total_sites, size_t iterations, size_t wgsize, int use_device)
-{ 
+double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c,
+              size_t total_sites, size_t iterations, size_t wgsize, int use_device, Profile* profile)
+{
+  OpenCLBuild kernel_build = CL_GENERIC;
+  std::string cache_dir = CL_CACHE_DIR;
+
+  // Set the kernel build and the program cache directory from the command line
+  int opt;
+  optind = 1;
+  while ((opt=getopt(g_argc, g_argv, ":p:C:")) != -1) {
+    switch (opt) {
+    case 'p':
+      for (int p = CL_GENERIC; p <= CL_VEC4; ++p)
+        if (std::string(optarg) == build_names[p])
+          kernel_build = (OpenCLBuild)p;
+      if (std::string(optarg) != build_names[kernel_build]) {
+        std::cout << "ERROR: Unknown kernel build " << optarg << " (generic|spec|vec2|vec4)" << std::endl;
+        exit(1);
+      }
+      break;
+    case 'C':
+      cache_dir = optarg;
+      break;
+    }
+  }
+
   // Setup OpenCL context and devices
   std::vector<cl::Device> devices;
   std::vector<cl::Platform> platforms;
@@ -89,51 +269,78 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
   cl::Context context(device);
   cl::CommandQueue queue(context);
 
-  // build the kernel
-  char build_args[80];
-  sprintf(build_args, "-I. -DPRECISION=%d -DUSE_OPENCL", PRECISION);
-  if (verbose >= 2)
-    std::cout << "Building Kernel with: " << build_args << std::endl;
-  cl::Program program(context, std::string(kernel_src));
-  if (program.build(build_args) != CL_SUCCESS) {
-    std::cout << "ERROR: OpenCL kernel failed to build" << std::endl;
+  size_t threads_per_site = kernel_build == CL_VEC4 ? THREADS_PER_SITE_VEC4 : THREADS_PER_SITE;
+  if (wgsize == 0)  // check to make sure work group size is set
+    wgsize = threads_per_site;
+  // round the number of work items up to whole workgroups
+  size_t total_wi = (total_sites * threads_per_site + wgsize - 1) / wgsize * wgsize;
+
+  // build the kernel, the specialised builds bake in the problem shape
+  // the headers are found by absolute path, so the build does not depend on the cwd
+  char include_dir[PATH_MAX];
+  if (realpath(CL_INCLUDE_DIR, include_dir) == NULL) {
+    std::cout << "ERROR: Cannot find the kernel include directory " << CL_INCLUDE_DIR << std::endl;
     exit(1);
   }
+  char build_args[PATH_MAX + 256];
+  int len = sprintf(build_args, "-I%s -DPRECISION=%d -DUSE_OPENCL", include_dir, PRECISION);
+  if (kernel_build != CL_GENERIC)
+    len += sprintf(build_args + len, " -DTOTAL_SITES=%zuUL -DWG_SIZE=%zu", total_sites, wgsize);
+  if (kernel_build == CL_VEC2)
+    sprintf(build_args + len, " -DVEC=2");
+  else if (kernel_build == CL_VEC4)
+    sprintf(build_args + len, " -DVEC=4");
+  if (verbose >= 2)
+    std::cout << "Building Kernel with: " << build_args << std::endl;
+  cl::Program program = build_program(context, device, include_dir, build_args, cache_dir, profile);
+
+  auto tprofiling = Clock::now();
+  int64_t ttrace = trace_now();
 
   // Declare target storage and copy A and B
   auto d_a = cl::Buffer(context, begin(a), end(a), true);
   auto d_b = cl::Buffer(context, begin(b), end(b), true);
   auto d_c = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(site)*c.size());
+  queue.finish();
+
+  profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("host_to_device", ttrace);
 
   // Make the kernel and set the arguments
   cl::Kernel k_mat_nn(program, "k_mat_nn");
   k_mat_nn.setArg(0, d_a);
   k_mat_nn.setArg(1, d_b);
   k_mat_nn.setArg(2, d_c);
-  k_mat_nn.setArg(3, (int)total_sites);
+  k_mat_nn.setArg(3, (cl_ulong)total_sites);
 
-  size_t total_wi = total_sites * THREADS_PER_SITE;
-  if (wgsize == 0)  // check to make sure work group size is set
-    wgsize = THREADS_PER_SITE;
   if (verbose >= 1) {
+    std::cout << "Kernel build set to " << build_names[kernel_build] << std::endl;
     std::cout << "Setting number of work items " << total_wi << std::endl;
     std::cout << "Setting workgroup size to " << wgsize << std::endl;
   }
 
   // benchmark loop
   auto tstart = Clock::now();
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  tprofiling = tstart;
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
-      queue.finish(); 
+      queue.finish();
       tstart = Clock::now();
+      tprofiling = tstart;
 	  }
     queue.enqueueNDRangeKernel(k_mat_nn, cl::NullRange, cl::NDRange(total_wi), cl::NDRange(wgsize));
   }
-  queue.finish(); 
+  queue.finish();
+  profile->kernel_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
   double ttotal = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tstart).count();
 
   // copy data back from device
+  tprofiling = Clock::now();
+  ttrace = trace_now();
   cl::copy(queue, d_c, begin(c), end(c));
+  profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("device_to_host", ttrace);
 
   return (ttotal /= 1.0e6);
 }
@@ -37,8 +37,10 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
   // Move A and B data to the device, Allocate C data
   double ttotal;
   auto tprofiling = Clock::now();
+  int64_t ttrace = trace_now();
   #pragma omp target enter data map(to: d_a[0:len_a], d_b[0:len_b]) map(alloc: d_c[0:len_c])
   profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("host_to_device", ttrace);
 
   // benchmark loop
   auto tstart = Clock::now();
@@ -55,14 +57,15 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
     std::cout << "Threads per team = " << threads_per_team << std::endl;
   }
 
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
       tstart = Clock::now();
       tprofiling = tstart;
     }
 
     #pragma omp target teams distribute
-    for(int i=0;i<total_sites;++i) {
+    for(size_t i=0;i<total_sites;++i) {
       #pragma omp parallel for collapse(3)
       for (int j=0; j<4; ++j) {
         for(int k=0;k<3;k++) {
@@ -94,7 +97,8 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
     std::cout << "Threads per team = " << threads_per_team << std::endl;
   }
 
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
       tstart = Clock::now();
       tprofiling = tstart;
@@ -106,13 +110,13 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
       {
         int total_teams = omp_get_num_teams();
         int team_id = omp_get_team_num();
-        int sites_per_team = (total_sites + total_teams - 1) / total_teams;
-        int istart = team_id * sites_per_team;
+        size_t sites_per_team = (total_sites + total_teams - 1) / total_teams;
+        size_t istart = team_id * sites_per_team;
         if (istart > total_sites) istart = total_sites;
-        int iend = istart + sites_per_team;
+        size_t iend = istart + sites_per_team;
         if (iend > total_sites) iend = total_sites;
 
-        for (int i = istart; i < iend; ++i) {
+        for (size_t i = istart; i < iend; ++i) {
           #pragma omp for collapse(3)
           for (int j=0; j<4; ++j) {
             for(int k=0;k<3;k++) {
@@ -150,15 +154,16 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
     std::cout << "Number of work items = " << num_work_items << std::endl;
   }
 
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
       tstart = Clock::now();
       tprofiling = tstart;
     }
 
     #pragma omp target teams distribute parallel for
-    for (int id =0; id < num_work_items; id++) {
-      int i = id/36;
+    for (size_t id =0; id < num_work_items; id++) {
+      size_t i = id/36;
       if (i < total_sites) {
         int j = (id%36)/9;
         int k = (id%9)/3;
@@ -200,7 +205,8 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
 #endif
   }
 
-  for (int iters=0; iters<iterations+warmups; ++iters) {
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
       tstart = Clock::now();
       tprofiling = tstart;
@@ -215,7 +221,7 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
 #elif USE_VERSION == 4
     #pragma omp target teams loop collapse(4)
 #endif
-    for(int i=0;i<total_sites;++i) {
+    for(size_t i=0;i<total_sites;++i) {
       for (int j=0; j<4; ++j) {
         for(int k=0;k<3;k++) {
           for(int l=0;l<3;l++){
@@ -250,15 +256,17 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
 
   // C gets moved back to the host
   tprofiling = Clock::now();
+  ttrace = trace_now();
   #pragma omp target exit data map(from: d_c[0:len_c])
   profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("device_to_host", ttrace);
 
   // It is not possible to check for NaNs when the application is compiled with -ffast-math
   // Therefore we print out the calculated checksum as a manual check for the user.
   // This is helpful when using LLVM/Clang-10.0 to compile the OpenMP target offload
   // implementation without MILC_COMPLEX (i.e. using std::complex).
   double sum = 0.0;
-  for (int i=0;i<total_sites;++i) for(int j=0;j<4;++j)  for(int k=0;k<3;++k)  for(int l=0;l<3;++l) {
+  for(size_t i=0;i<total_sites;++i) for(int j=0;j<4;++j)  for(int k=0;k<3;++k)  for(int l=0;l<3;++l) {
     Complx cc = {0.0, 0.0};
     for(int m=0;m<3;m++) {
       #ifdef MILC_COMPLEX
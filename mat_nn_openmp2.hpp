@@ -6,6 +6,18 @@
   #define USE_VERSION 1
 #endif
 
+// Output link accessors, returning the four links written for site i
+//   site_links - the links of an array of sites
+//   bare_links - a bare link field, four links per site
+struct site_links {
+  site *c;
+  su3_matrix *operator()(size_t i) const { return c[i].link; }
+};
+struct bare_links {
+  su3_matrix *c;
+  su3_matrix *operator()(size_t i) const { return c + 4*i; }
+};
+
 void first_touch(site *a, su3_matrix *b, site *c,
 		 size_t total_sites)
 {
@@ -24,7 +36,7 @@ void first_touch(site *a, su3_matrix *b, site *c,
 #else
     // Nothing
 #endif
-  for(int i=0;i<total_sites;++i) {
+  for(size_t i=0;i<total_sites;++i) {
 #if USE_VERSION == 3
 # pragma omp loop bind(thread)
 #endif
@@ -46,7 +58,8 @@ void first_touch(site *a, su3_matrix *b, site *c,
 	    a[i].link[j].e[k][m] = cc;
 	    b[j].e[m][l] = cc;
 	  }
-	  c[i].link[j].e[k][l] = cc;
+	  if (c != NULL)
+	    c[i].link[j].e[k][l] = cc;
 #else
 # if USE_VERSION == 2 || USE_VERSION == 3
 #  pragma omp loop bind(thread)
@@ -57,8 +70,10 @@ void first_touch(site *a, su3_matrix *b, site *c,
 	    b[j].e[m][l].real = cc.real;
 	    b[j].e[m][l].imag = cc.imag;
 	  }
-	  c[i].link[j].e[k][l].real = cc.real;
-	  c[i].link[j].e[k][l].imag = cc.imag;
+	  if (c != NULL) {
+	    c[i].link[j].e[k][l].real = cc.real;
+	    c[i].link[j].e[k][l].imag = cc.imag;
+	  }
 #endif
 	}
       }
@@ -66,19 +81,59 @@ void first_touch(site *a, su3_matrix *b, site *c,
   }
 }
 
-double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c, 
-		  size_t total_sites, size_t iterations, size_t threads_per_team, int use_device)
+// first touch of a bare output link field
+void first_touch_links(su3_matrix *c, size_t total_links)
 {
-  if (verbose > 0)
-    std::cout << "Number of threads = " << omp_get_max_threads() << std::endl;
+  #pragma omp parallel for
+  for(size_t i=0;i<total_links;++i)
+    for(int k=0;k<3;k++)
+      for(int l=0;l<3;l++)
+        c[i].e[k][l] = Complx{0.0, 0.0};
+}
 
-  // benchmark loop
-  double ttotal;
-  auto tstart = Clock::now();
-  for (int iters=0; iters<iterations+warmups; ++iters) {
-    if (iters == warmups)
-      tstart = Clock::now();
+// C = A*B for a single site, used inside an enclosing parallel region
+static inline void mult_su3_site(const site *a, const su3_matrix *b, su3_matrix *c)
+{
+  for (int j=0; j<4; ++j) {
+    for(int k=0;k<3;k++) {
+      for(int l=0;l<3;l++){
+        Complx cc = {0.0, 0.0};
+        for(int m=0;m<3;m++) {
+#ifndef MILC_COMPLEX
+          cc += a->link[j].e[k][m] * b[j].e[m][l];
+#else
+          CMULSUM(a->link[j].e[k][m], b[j].e[m][l], cc);
+#endif
+        }
+        c[j].e[k][l] = cc;
+      }
+    }
+  }
+}
+
+// C = A*B with a trace zone around the share of each thread
+template <class Output>
+static void k_mat_nn_traced(site *a, su3_matrix *b, Output c, size_t total_sites)
+{
+  #pragma omp parallel
+  {
+    TRACE_ZONE("k_mat_nn chunk");
+    #pragma omp for nowait
+    for(size_t i=0;i<total_sites;++i)
+      mult_su3_site(&a[i], b, c(i));
+  }
+}
 
+// C = A*B for all sites, one parallel region per call
+template <class Output>
+static void k_mat_nn(site *a, su3_matrix *b, Output c, size_t total_sites)
+{
+#if USE_VERSION == 1
+  if (trace_enabled) {
+    k_mat_nn_traced(a, b, c, total_sites);
+    return;
+  }
+#endif
 #if USE_VERSION == 0
 # pragma omp parallel for collapse(4)
 #elif USE_VERSION == 1
@@ -92,54 +147,168 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
 #elif USE_VERSION == 5
 # pragma omp target teams distribute parallel for
 #else
-    // Nothing
+  // Nothing
 #endif
-    for(int i=0;i<total_sites;++i) {
+  for(size_t i=0;i<total_sites;++i) {
 #if USE_VERSION == 3
 # pragma omp loop bind(thread)
 #endif
-      for (int j=0; j<4; ++j) {
+    for (int j=0; j<4; ++j) {
 #if USE_VERSION == 3
 # pragma omp loop bind(thread)
 #endif
-        for(int k=0;k<3;k++) {
+      for(int k=0;k<3;k++) {
 #if USE_VERSION == 3
 # pragma omp loop bind(thread)
 #endif
-          for(int l=0;l<3;l++){
-            Complx cc = {0.0, 0.0};
+        for(int l=0;l<3;l++){
+          Complx cc = {0.0, 0.0};
 #ifndef MILC_COMPLEX
 # if USE_VERSION == 2 || USE_VERSION == 3
 #  pragma omp loop bind(thread)
 # endif
-            for(int m=0;m<3;m++) {
-               cc += a[i].link[j].e[k][m] * b[j].e[m][l];
-            }
-            c[i].link[j].e[k][l] = cc;
+          for(int m=0;m<3;m++) {
+             cc += a[i].link[j].e[k][m] * b[j].e[m][l];
+          }
+          c(i)[j].e[k][l] = cc;
 #else
 # if USE_VERSION == 2 || USE_VERSION == 3
 #  pragma omp loop bind(thread)
 # endif
-            for(int m=0;m<3;m++) {
-               CMULSUM(a[i].link[j].e[k][m], b[j].e[m][l], cc);
-            }
-            c[i].link[j].e[k][l].real = cc.real;
-            c[i].link[j].e[k][l].imag = cc.imag;
+          for(int m=0;m<3;m++) {
+             CMULSUM(a[i].link[j].e[k][m], b[j].e[m][l], cc);
+          }
+          c(i)[j].e[k][l].real = cc.real;
+          c(i)[j].e[k][l].imag = cc.imag;
+#endif
+        }
+      }
+    }
+  }
+}
+
+// The other members of the mult_su3 family, C = op(A, B) for every link
+template <MultVariant V>
+static void k_mult_su3(site *a, su3_matrix *b, site *c, size_t total_sites)
+{
+  #pragma omp parallel for
+  for(size_t i=0;i<total_sites;++i)
+    for (int j=0; j<4; ++j)
+      mult_su3<V>(&a[i].link[j], &b[j], &c[i].link[j]);
+}
+
+static void k_mult_su3(MultVariant v, site *a, su3_matrix *b, site *c, size_t total_sites)
+{
+  switch (v) {
+  case MULT_NA:      k_mult_su3<MULT_NA>(a, b, c, total_sites); break;
+  case MULT_AN:      k_mult_su3<MULT_AN>(a, b, c, total_sites); break;
+  case MULT_NN_ACC:  k_mult_su3<MULT_NN_ACC>(a, b, c, total_sites); break;
+  case MULT_NN_AXPY: k_mult_su3<MULT_NN_AXPY>(a, b, c, total_sites); break;
+  default:           k_mat_nn(a, b, site_links{c}, total_sites);
+  }
+}
+
+// A = A*B for all sites, the products are formed in per-site temporaries
+static void k_mat_nn_inplace(site *a, su3_matrix *b, size_t total_sites)
+{
+  #pragma omp parallel for
+  for(size_t i=0;i<total_sites;++i) {
+    su3_matrix tmp[4];
+    for (int j=0; j<4; ++j) {
+      for(int k=0;k<3;k++) {
+        for(int l=0;l<3;l++){
+          Complx cc = {0.0, 0.0};
+          for(int m=0;m<3;m++) {
+#ifndef MILC_COMPLEX
+            cc += a[i].link[j].e[k][m] * b[j].e[m][l];
+#else
+            CMULSUM(a[i].link[j].e[k][m], b[j].e[m][l], cc);
 #endif
           }
+          tmp[j].e[k][l] = cc;
         }
       }
     }
+    for (int j=0; j<4; ++j)
+      a[i].link[j] = tmp[j];
+  }
+}
+
+// Times iterations+warmups calls of kernel(), returning the time of the last iterations
+template <class Kernel>
+static double time_iterations(size_t iterations, Profile* profile, Kernel kernel)
+{
+  if (verbose > 0)
+    std::cout << "Number of threads = " << omp_get_max_threads() << std::endl;
+
+  // The lattices are shared with the host, there are no transfers
+  profile->host_to_device_time = 0.0;
+  profile->device_to_host_time = 0.0;
+
+  auto tstart = Clock::now();
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    kernel();
+  }
+  profile->kernel_time = std::chrono::duration<double>(Clock::now()-tstart).count();
+  return profile->kernel_time;
+}
+
+// C = A*B with C a bare link field
+double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<su3_matrix> &c,
+		  size_t total_sites, size_t iterations, size_t threads_per_team, int use_device, Profile* profile)
+{
+  return time_iterations(iterations, profile, [&]() {
+    k_mat_nn(a.data(), b.data(), bare_links{c.data()}, total_sites);
+  });
+}
+
+// A = A*B
+double su3_mat_nn_inplace(std::vector<site> &a, std::vector<su3_matrix> &b,
+		  size_t total_sites, size_t iterations, size_t threads_per_team, int use_device, Profile* profile)
+{
+  return time_iterations(iterations, profile, [&]() {
+    k_mat_nn_inplace(a.data(), b.data(), total_sites);
+  });
+}
+
+double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c, 
+		  size_t total_sites, size_t iterations, size_t threads_per_team, int use_device, Profile* profile)
+{
+  if (verbose > 0)
+    std::cout << "Number of threads = " << omp_get_max_threads() << std::endl;
+
+  // The lattices are shared with the host, there are no transfers
+  profile->host_to_device_time = 0.0;
+  profile->device_to_host_time = 0.0;
+
+  // benchmark loop
+  double ttotal;
+  auto tstart = Clock::now();
+  for (size_t iters=0; iters<iterations+warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    k_mult_su3(mult_variant, a.data(), b.data(), c.data(), total_sites);
   }
 
   ttotal = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tstart).count();
+  profile->kernel_time = ttotal/1.0e6;
+
+  // The checksum applies to C = A*B only
+  if (mult_variant != MULT_NN)
+    return (ttotal /= 1.0e6);
 
   // It is not possible to check for NaNs when the application is compiled with -ffast-math
   // Therefore we print out the calculated checksum as a manual check for the user.
   // This is helpful when using LLVM/Clang-10.0 to compile the OpenMP target offload
   // implementation without MILC_COMPLEX (i.e. using std::complex).
+  TRACE_ZONE("checksum");
   double sum = 0.0;
-  for (int i=0;i<total_sites;++i) for(int j=0;j<4;++j)  for(int k=0;k<3;++k)  for(int l=0;l<3;++l) {
+  for(size_t i=0;i<total_sites;++i) for(int j=0;j<4;++j)  for(int k=0;k<3;++k)  for(int l=0;l<3;++l) {
     Complx cc = {0.0, 0.0};
     for(int m=0;m<3;m++) {
       #ifdef MILC_COMPLEX
@@ -166,3 +335,37 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
 
   return (ttotal /= 1.0e6);
 }
+
+// Launch latency measurement
+// Records the time of each synchronous call to k_mat_nn(), each of which opens
+// a new parallel region, then returns the time to issue all the iterations from
+// a single parallel region.  The asynchronous form drops the barrier between
+// iterations, which is safe as the static schedule assigns the same sites to
+// each thread in every iteration.
+double su3_mat_nn_latency(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c,
+		  size_t total_sites, size_t iterations, size_t threads_per_team, int use_device,
+		  std::vector<double> &latency)
+{
+  site *d_a = a.data();
+  su3_matrix *d_b = b.data();
+  site *d_c = c.data();
+
+  for (size_t iters=0; iters<warmups; ++iters)
+    k_mat_nn(d_a, d_b, site_links{d_c}, total_sites);
+
+  latency.resize(iterations);
+  for (size_t iters=0; iters<iterations; ++iters) {
+    auto tlaunch = Clock::now();
+    k_mat_nn(d_a, d_b, site_links{d_c}, total_sites);
+    latency[iters] = std::chrono::duration<double>(Clock::now()-tlaunch).count();
+  }
+
+  auto tstart = Clock::now();
+  #pragma omp parallel
+  for (size_t iters=0; iters<iterations; ++iters) {
+    #pragma omp for schedule(static) nowait
+    for (size_t i=0; i<total_sites; ++i)
+      mult_su3_site(&d_a[i], d_b, d_c[i].link);
+  }
+  return std::chrono::duration<double>(Clock::now()-tstart).count();
+}
@@ -1,6 +1,8 @@
 #include "RAJA/RAJA.hpp"
 #include "umpire/Allocator.hpp"
 #include "umpire/ResourceManager.hpp"
+#include "umpire/strategy/QuickPool.hpp"
+#include <string>
 
 #define THREADS_PER_SITE 36
 
@@ -10,14 +12,36 @@
   using threads_x = RAJA::LoopPolicy<RAJA::cuda_thread_x_direct>;
   using threads_y = RAJA::LoopPolicy<RAJA::cuda_thread_y_direct>;
   using threads_z = RAJA::LoopPolicy<RAJA::cuda_thread_z_direct>;
+  #define RAJA_DEVICE_BUILD
 #elif defined(RAJA_ENABLE_HIP)
   using launch_policy = RAJA::LaunchPolicy<RAJA::hip_launch_t<false>>;
   using teams_x = RAJA::LoopPolicy<RAJA::hip_block_x_loop>;
   using threads_x = RAJA::LoopPolicy<RAJA::hip_thread_x_direct>;
   using threads_y = RAJA::LoopPolicy<RAJA::hip_thread_y_direct>;
   using threads_z = RAJA::LoopPolicy<RAJA::hip_thread_z_direct>;
+  #define RAJA_DEVICE_BUILD
 #endif
 
+// Host policy sets, one site per loop iteration
+#if defined(RAJA_ENABLE_OPENMP)
+  using host_launch_policy = RAJA::LaunchPolicy<RAJA::omp_launch_t>;
+  using host_sites = RAJA::LoopPolicy<RAJA::omp_for_exec>;
+  using host_parallel_policy = RAJA::omp_parallel_for_exec;
+#else
+  using host_launch_policy = RAJA::LaunchPolicy<RAJA::seq_launch_t>;
+  using host_sites = RAJA::LoopPolicy<RAJA::seq_exec>;
+  using host_parallel_policy = RAJA::seq_exec;
+#endif
+
+// Policies selectable with -p
+//   device - RAJA::launch with 36 GPU threads per site (GPU builds only)
+//   seq    - RAJA::forall with seq_exec
+//   omp    - RAJA::forall with omp_parallel_for_exec
+//   simd   - RAJA::forall with simd_exec
+//   launch - RAJA::launch with omp_launch_t and an omp_for_exec site loop
+enum RajaPolicy { R_DEVICE, R_SEQ, R_OMP, R_SIMD, R_LAUNCH };
+static const char *policy_names[] = {"device", "seq", "omp", "simd", "launch"};
+
 static void synchronize() {
   // nothing to do for host devices
 #if defined(RAJA_ENABLE_CUDA)
@@ -31,24 +55,151 @@ static void synchronize() {
 #endif
 }
 
+// Site level kernel shared by the host forall policies
+template <class ExecPolicy>
+static void k_mat_nn_forall(const site *d_a, const su3_matrix *d_b, site *d_c, size_t total_sites) {
+  RAJA::forall<ExecPolicy>(RAJA::TypedRangeSegment<size_t>(0, total_sites), [=] (size_t i) {
+    for (int j = 0; j < 4; j++) {
+      for (int k = 0; k < 3; k++) {
+        for (int l = 0; l < 3; l++) {
+          Complx cc = {0.0, 0.0};
+          for (int m = 0; m < 3; m++) {
+            CMULSUM(d_a[i].link[j].e[k][m], d_b[j].e[m][l], cc);
+          }
+          d_c[i].link[j].e[k][l] = cc;
+        }
+      }
+    }
+  });
+}
+
+// Site level kernel using a host launch region
+static void k_mat_nn_host_launch(const site *d_a, const su3_matrix *d_b, site *d_c, size_t total_sites) {
+  RAJA::launch<host_launch_policy>(RAJA::ExecPlace::HOST, RAJA::LaunchParams(),
+    [=] (RAJA::LaunchContext ctx) {
+      RAJA::loop<host_sites>(ctx, RAJA::TypedRangeSegment<size_t>(0, total_sites), [&] (size_t i) {
+        for (int j = 0; j < 4; j++) {
+          for (int k = 0; k < 3; k++) {
+            for (int l = 0; l < 3; l++) {
+              Complx cc = {0.0, 0.0};
+              for (int m = 0; m < 3; m++) {
+                CMULSUM(d_a[i].link[j].e[k][m], d_b[j].e[m][l], cc);
+              }
+              d_c[i].link[j].e[k][l] = cc;
+            }
+          }
+        }
+      });
+    });
+}
+
+#if defined(RAJA_DEVICE_BUILD)
+// 36 threads per site, sites_per_block sites per team
+static void k_mat_nn_device(const site *d_a, const su3_matrix *d_b, site *d_c, size_t total_sites, int sites_per_block) {
+  const int teams = (total_sites + sites_per_block - 1) / sites_per_block;
+
+  RAJA::launch<launch_policy>(RAJA::ExecPlace::DEVICE,
+    RAJA::LaunchParams(RAJA::Teams(teams), RAJA::Threads(sites_per_block*4,3,3)),
+      [=] RAJA_HOST_DEVICE (RAJA::LaunchContext ctx) {
+        RAJA::loop<teams_x>(ctx, RAJA::TypedRangeSegment<int>(0, (teams)), [&] (int site) {
+          RAJA::loop<threads_x>(ctx, RAJA::TypedRangeSegment<int>(0, sites_per_block *4), [&] (int j) {
+            RAJA::loop<threads_y>(ctx, RAJA::TypedRangeSegment<int>(0, 3), [&] (int k) {
+              RAJA::loop<threads_z>(ctx, RAJA::TypedRangeSegment<int>(0, 3), [&] (int l) {
+                const int site_id = j / 4;
+                const size_t my_site = (size_t)site * sites_per_block + site_id;
+                const int jj = j % 4;
+                if ( my_site < total_sites ) {
+                  Complx cc = {0.0, 0.0};
+                  for (int m = 0; m < 3; m++) {
+                    CMULSUM(d_a[my_site].link[jj].e[k][m], d_b[jj].e[m][l], cc);
+                  }
+                  d_c[my_site].link[jj].e[k][l] = cc;
+                }
+              });
+            });
+         });
+      });
+    });
+}
+#endif
+
 double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<site> &c, size_t total_sites, size_t iterations, size_t threadsPerBlock, int device, Profile* profile) {
   size_t size_a = sizeof(site) * total_sites;
   size_t size_b = sizeof(su3_matrix) * 4;
   size_t size_c = sizeof(site) * total_sites;
 
+#if defined(RAJA_DEVICE_BUILD)
+  RajaPolicy policy = R_DEVICE;
+#elif defined(RAJA_ENABLE_OPENMP)
+  RajaPolicy policy = R_OMP;
+#else
+  RajaPolicy policy = R_SEQ;
+#endif
+
+  // Set the execution policy from the command line
+  int opt;
+  optind = 1;
+  while ((opt=getopt(g_argc, g_argv, ":p:")) != -1) {
+    switch (opt) {
+    case 'p':
+      for (int p = R_DEVICE; p <= R_LAUNCH; ++p)
+        if (std::string(optarg) == policy_names[p])
+          policy = (RajaPolicy)p;
+      if (std::string(optarg) != policy_names[policy]) {
+        fprintf(stderr, "ERROR: Unknown RAJA policy %s (device|seq|omp|simd|launch)\n", optarg);
+        exit(1);
+      }
+      break;
+    }
+  }
+#if defined(RAJA_DEVICE_BUILD)
+  // the working copies live in device memory, which the host policies cannot touch
+  if (policy != R_DEVICE) {
+    fprintf(stderr, "ERROR: The %s policy requires a host build of RAJA, use -p device\n", policy_names[policy]);
+    exit(1);
+  }
+#else
+  if (policy == R_DEVICE) {
+    fprintf(stderr, "ERROR: The device policy requires a CUDA or HIP enabled RAJA\n");
+    exit(1);
+  }
+#endif
+#if !defined(RAJA_ENABLE_OPENMP)
+  if (policy == R_OMP || policy == R_LAUNCH) {
+    fprintf(stderr, "ERROR: The %s policy requires an OpenMP enabled RAJA\n", policy_names[policy]);
+    exit(1);
+  }
+#endif
+
+  if (threadsPerBlock == 0)
+    threadsPerBlock = THREADS_PER_SITE;
+  // Whole sites per block, any remaining threads in each block go unused
+  const int sites_per_block = threadsPerBlock < THREADS_PER_SITE ? 1 : threadsPerBlock / THREADS_PER_SITE;
+
+  if (verbose >= 1) {
+    printf("Execution policy set to %s\n", policy_names[policy]);
+    if (policy == R_DEVICE)
+      printf("Threads per block set to %d\n", sites_per_block * THREADS_PER_SITE);
+  }
+
   auto tprofiling = Clock::now();
+  int64_t ttrace = trace_now();
 
   auto &rm = umpire::ResourceManager::getInstance();
   auto host_alloc = rm.getAllocator("HOST");
   auto strategy = host_alloc.getAllocationStrategy();
+#if defined(RAJA_DEVICE_BUILD)
   auto device_alloc = rm.getAllocator("DEVICE");
+#else
+  // On the host the working copies are carved out of a memory pool
+  if (!rm.isAllocator("HOST_POOL"))
+    rm.makeAllocator<umpire::strategy::QuickPool>("HOST_POOL", host_alloc);
+  auto device_alloc = rm.getAllocator("HOST_POOL");
+#endif
 
-  if (threadsPerBlock == 0)
-    threadsPerBlock = THREADS_PER_SITE;
-
-  umpire::util::AllocationRecord record_a{a.data(), size_a, strategy}; 
-  umpire::util::AllocationRecord record_b{b.data(), size_b, strategy}; 
-  umpire::util::AllocationRecord record_c{c.data(), size_c, strategy}; 
+  umpire::util::AllocationRecord record_a{a.data(), size_a, strategy};
+  umpire::util::AllocationRecord record_b{b.data(), size_b, strategy};
+  umpire::util::AllocationRecord record_c{c.data(), size_c, strategy};
 
   rm.registerAllocation(a.data(), record_a);
   rm.registerAllocation(b.data(), record_b);
@@ -63,49 +214,64 @@ double su3_mat_nn(std::vector<site> &a, std::vector<su3_matrix> &b, std::vector<
   rm.copy(d_c, c.data());
 
   profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
-
-  constexpr int threads_per_site = 4 * 3 * 3;
-  constexpr int threads_per_block = 128;
-  constexpr int sites_per_block = threads_per_block / threads_per_site; // 7 sites per block. Last four threads in each block go unused.
-  const int teams = (total_sites + sites_per_block - 1) / sites_per_block; // (1048576 + 7 - 1) / 7 = 149797 teams. 1048579 sites attempted, last 3 should be skipped
+  trace_record("host_to_device", ttrace);
 
   auto tstart = Clock::now();
   tprofiling = tstart;
-  
+
   for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
     if (iters == warmups) {
+      synchronize();
       tstart = Clock::now();
       tprofiling = tstart;
     }
-    RAJA::launch<launch_policy>(RAJA::ExecPlace::DEVICE,
-      RAJA::LaunchParams(RAJA::Teams(teams), RAJA::Threads(sites_per_block*4,3,3)),
-        [=] RAJA_HOST_DEVICE (RAJA::LaunchContext ctx) {
-          RAJA::loop<teams_x>(ctx, RAJA::TypedRangeSegment<int>(0, (teams)), [&] (int site) {
-            RAJA::loop<threads_x>(ctx, RAJA::TypedRangeSegment<int>(0, sites_per_block *4), [&] (int j) {
-              RAJA::loop<threads_y>(ctx, RAJA::TypedRangeSegment<int>(0, 3), [&] (int k) {
-                RAJA::loop<threads_z>(ctx, RAJA::TypedRangeSegment<int>(0, 3), [&] (int l) {
-                  const int site_id = j / 4;
-                  const int my_site = (site * sites_per_block) + site_id;
-                  const int jj = j % 4;
-                  if ( my_site < total_sites ) {
-                    Complx cc = {0.0, 0.0};
-                    for (int m = 0; m < 3; m++) {
-                      CMULSUM(d_a[my_site].link[jj].e[k][m], d_b[jj].e[m][l], cc);
-                    }
-                    d_c[my_site].link[jj].e[k][l] = cc;
-                  }
-                });
-              });
-           });
-        });
-      });
+    switch (policy) {
+#if defined(RAJA_DEVICE_BUILD)
+    case R_DEVICE:
+      k_mat_nn_device(d_a, d_b, d_c, total_sites, sites_per_block);
+      break;
+#endif
+    case R_SEQ:
+      k_mat_nn_forall<RAJA::seq_exec>(d_a, d_b, d_c, total_sites);
+      break;
+    case R_SIMD:
+      k_mat_nn_forall<RAJA::simd_exec>(d_a, d_b, d_c, total_sites);
+      break;
+    case R_LAUNCH:
+      k_mat_nn_host_launch(d_a, d_b, d_c, total_sites);
+      break;
+    default:
+#if defined(RAJA_ENABLE_OPENMP)
+      if (trace_enabled) {
+        // the same static split, with a trace zone around the share of each thread
+        #pragma omp parallel
+        {
+          TRACE_ZONE("k_mat_nn chunk");
+          k_mat_nn_forall<RAJA::omp_for_nowait_static_exec<>>(d_a, d_b, d_c, total_sites);
+        }
+        break;
+      }
+#endif
+      k_mat_nn_forall<host_parallel_policy>(d_a, d_b, d_c, total_sites);
+    }
   }
+  synchronize();
   profile->kernel_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
   double ttotal = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tstart).count();
 
   tprofiling = Clock::now();
+  ttrace = trace_now();
   rm.copy(c.data(), d_c);
   profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("device_to_host", ttrace);
+
+  device_alloc.deallocate(d_a);
+  device_alloc.deallocate(d_b);
+  device_alloc.deallocate(d_c);
+  rm.deregisterAllocation(a.data());
+  rm.deregisterAllocation(b.data());
+  rm.deregisterAllocation(c.data());
 
   return (ttotal /= 1.0e6);
 }
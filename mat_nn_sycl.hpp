@@ -1,124 +1,311 @@
 // SYCL implementation
-#include <CL/sycl.hpp>
-#define USE_WORKAROUND
+// Covers both the buffer/accessor and the unified shared memory (USM) memory models
+#include <sycl/sycl.hpp>
+#include <cstring>
+#include <string>
 
 #define THREADS_PER_SITE 36
 
+// Memory models selectable with -u
+//   buffer - sycl::buffer with explicit copies through accessors
+//   device - malloc_device with explicit memcpy
+//   shared - malloc_shared, migrated to the device with prefetch
+//   host   - malloc_host, accessed by the device in place
+// Kernel forms selectable with -p
+//   ndrange - nd_range kernel with the -t workgroup size
+//   range   - plain range kernel, the runtime chooses the workgroup size
+enum SyclMemory { S_BUFFER, S_DEVICE, S_SHARED, S_HOST };
+enum SyclKernel { S_NDRANGE, S_RANGE };
+static const char *memory_names[] = {"buffer", "device", "shared", "host"};
+static const char *kernel_names[] = {"ndrange", "range"};
+
 // Sycl requires that kernels be named
-class k_mat_nn;
-
-double su3_mat_nn(const std::vector<site> &a, const std::vector<su3_matrix> &b, std::vector<site> &c, 
-              const size_t total_sites, const size_t iterations, size_t wgsize, const int target)
-{ 
-  using namespace cl::sycl;
-
-  // build a list of devices
-  std::vector<platform> platforms = platform::get_platforms();
-  std::vector<device> devices;
-  for (int i=0, d=0; i < platforms.size(); ++i) {
-    std::vector<device> pdevices = platforms[i].get_devices();
-    for (int j=0; j < pdevices.size(); ++j, ++d) {
+class k_mat_nn_buffer_nd;
+class k_mat_nn_buffer_range;
+class k_mat_nn_usm_nd;
+class k_mat_nn_usm_range;
+
+// When set, su3_mat_nn() records the per-launch latencies into latency_samples
+// and the time to submit all iterations before a single wait into latency_async
+static std::vector<double> *latency_samples = nullptr;
+static double latency_async = 0.0;
+
+//*******************  m_mat_nn.c  (in su3.a) ****************************
+//  void mult_su3_nn( su3_matrix *a,*b,*c )
+//  matrix multiply, no adjoints
+//  C  <-  A*B
+// One matrix element per work item
+static inline void k_mat_nn(const site *d_a, const su3_matrix *d_b, site *d_c,
+                            const size_t myThread, const size_t total_sites)
+{
+  size_t mySite = myThread/36;
+  if (mySite < total_sites) {
+    int j = (myThread%36)/9;
+    int k = (myThread%9)/3;
+    int l = myThread%3;
+    Complx cc = {0.0, 0.0};
+    for (int m=0;m<3;m++) {
+      const auto aa = d_a[mySite].link[j].e[k][m];
+      const auto bb = d_b[j].e[m][l];
+#ifndef MILC_COMPLEX
+      cc += aa * bb;
+#else
+      CMULSUM(aa, bb, cc);
+#endif
+    }
+    d_c[mySite].link[j].e[k][l] = cc;
+  }
+}
+
+// Builds the list of devices and creates a queue on the target device
+static sycl::queue make_queue(const int target)
+{
+  std::vector<sycl::platform> platforms = sycl::platform::get_platforms();
+  std::vector<sycl::device> devices;
+  for (size_t i=0, d=0; i < platforms.size(); ++i) {
+    std::vector<sycl::device> pdevices = platforms[i].get_devices();
+    for (size_t j=0; j < pdevices.size(); ++j, ++d) {
       devices.insert(devices.end(), pdevices[j]);
       if (verbose >= 3)
-        std::cout << "Appending device " << d << ": " << pdevices[j].get_info<info::device::name>() \
-                  << ":Driver " << pdevices[j].get_info<info::device::driver_version>() << std::endl;
+        std::cout << "Appending device " << d << ": " << pdevices[j].get_info<sycl::info::device::name>() \
+                  << ":Driver " << pdevices[j].get_info<sycl::info::device::driver_version>() << std::endl;
     }
   }
 
-  // Create a SYCL queue and set the device
-  device target_device;
+  sycl::device target_device;
   if (target < 0) {
-    default_selector selector;
-    target_device = selector.select_device();
-  } 
-  else if (target < devices.size()) {
+    target_device = sycl::device(sycl::default_selector_v);
+  }
+  else if (target < (int)devices.size()) {
     target_device = devices[target];
   }
   else {
     std::cout << "Invalid device specified: " << target << std::endl;
     exit(1);
   }
-  queue queue(target_device);
+  sycl::queue queue(target_device);
   if (verbose >= 2)
-    std::cout << "Using device " << target << ": " << queue.get_device().get_info<info::device::name>() \
-              << ":Driver " << queue.get_device().get_info<info::device::driver_version>() << std::endl;
+    std::cout << "Using device " << target << ": " << queue.get_device().get_info<sycl::info::device::name>() \
+              << ":Driver " << queue.get_device().get_info<sycl::info::device::driver_version>() << std::endl;
 
   // FYI, look at device maximums
   if (verbose >= 3) {
-    std::cout << "max compute units = " 
-       << queue.get_device().get_info<info::device::max_compute_units>() << "\n";
-    std::cout << "max workgroup size = " 
-       << queue.get_device().get_info<info::device::max_work_group_size>() << "\n";
+    std::cout << "max compute units = "
+       << queue.get_device().get_info<sycl::info::device::max_compute_units>() << "\n";
+    std::cout << "max workgroup size = "
+       << queue.get_device().get_info<sycl::info::device::max_work_group_size>() << "\n";
   }
+  return queue;
+}
+
+double su3_mat_nn(const std::vector<site> &a, const std::vector<su3_matrix> &b, std::vector<site> &c,
+		  const size_t total_sites, const size_t iterations, size_t wgsize, const int target, Profile* profile)
+{
+#ifdef USE_DPCPP
+  SyclMemory memory = S_DEVICE;
+#else
+  SyclMemory memory = S_BUFFER;
+#endif
+  SyclKernel kernel = S_NDRANGE;
+
+  // Set the memory model and kernel form from the command line
+  int opt;
+  optind = 1;
+  while ((opt=getopt(g_argc, g_argv, ":u:p:")) != -1) {
+    switch (opt) {
+    case 'u':
+      for (int u = S_BUFFER; u <= S_HOST; ++u)
+        if (std::string(optarg) == memory_names[u])
+          memory = (SyclMemory)u;
+      if (std::string(optarg) != memory_names[memory]) {
+        fprintf(stderr, "ERROR: Unknown SYCL memory model %s (buffer|device|shared|host)\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'p':
+      for (int p = S_NDRANGE; p <= S_RANGE; ++p)
+        if (std::string(optarg) == kernel_names[p])
+          kernel = (SyclKernel)p;
+      if (std::string(optarg) != kernel_names[kernel]) {
+        fprintf(stderr, "ERROR: Unknown SYCL kernel form %s (ndrange|range)\n", optarg);
+        exit(1);
+      }
+      break;
+    }
+  }
+
+  sycl::queue queue = make_queue(target);
 
   // check to make sure the workgroup size is sufficient for the algorithm
   if (wgsize == 0)
     wgsize = THREADS_PER_SITE;
 
-  // set the total number of work items
+  // set the total number of work items, padded to whole workgroups for nd_range
   size_t total_wi = total_sites * THREADS_PER_SITE;
+  if (kernel == S_NDRANGE)
+    total_wi = (total_wi + wgsize - 1) / wgsize * wgsize;
+  if (verbose >= 1) {
+    std::cout << "Memory model set to " << memory_names[memory] << std::endl;
+    std::cout << "Kernel form set to " << kernel_names[kernel] << std::endl;
+  }
   if (verbose >= 3) {
     std::cout << "Setting number of work items " << total_wi << std::endl;
     std::cout << "Workgroup size is " << wgsize << std::endl;
   }
   std::cout << std::flush;
 
-  // wrap arrays in SYCL buffers, suppling global memory pointer implicitly copies the data to the device when needed
-  buffer<site, 1>       a_buf {a.data(), range<1> {total_sites}};
-  buffer<su3_matrix, 1> b_buf {b.data(), range<1> {4}};
-  buffer<site, 1>       c_buf {range<1> {total_sites}};
-  // The copy of c from device -> host will occur when the destructor is called (at the end of the scope)
-	c_buf.set_final_data(c.data());
-
-  // benchmark loop
-  auto tstart = Clock::now();
-  for (int iters=0; iters<iterations+warmups; ++iters) {
-    if (iters == warmups) {
-      queue.wait(); 
-      tstart = Clock::now();
-	  }
-
-    // create a command_group to issue commands
-    queue.submit([&](handler& cgh) {
-      // request access to the host buffers
-      auto d_a = a_buf.get_access<access::mode::read>(cgh);
-      auto d_b = b_buf.get_access<access::mode::read>(cgh);
-      auto d_c = c_buf.get_access<access::mode::write>(cgh);
-
-      // Lambda function defines the kernel scope
-      cgh.parallel_for<class k_mat_nn>(
-      nd_range<1> {total_wi, wgsize}, [=](nd_item<1> item) {
-        size_t myThread = item.get_global_id(0);
-        size_t mySite = myThread/36;
-        if (mySite < total_sites) {
-          int j = (myThread%36)/9;
-          int k = (myThread%9)/3;
-          int l = myThread%3;
-          Complx cc = {0.0, 0.0};
-          for (int m=0;m<3;m++) {
-#ifndef USE_WORKAROUND
-            // This is the nominal code
-            const auto aa = d_a[mySite].link[j].e[k][m];
-            const auto bb = d_b[j].e[m][l];
-#else
-            // This code derefrences both d_a and d_b to Complx pointers
-            const auto aa = (d_a.get_pointer() + mySite)->link[j].e[k][m];
-            const auto bb = (d_b.get_pointer() + j)->e[m][l];
-#endif
-#ifndef MILC_COMPLEX
-            cc += aa * bb;
-#else
-            CMULSUM(aa, bb, cc);
-#endif
-          }
-          d_c[mySite].link[j].e[k][l] = cc;
-        }
-      }); // end of the kernel lambda function
+  auto tprofiling = Clock::now();
+  int64_t ttrace = trace_now();
+
+  // Buffers are created without host pointers, so all copies are explicit and timed
+  sycl::buffer<site, 1>       a_buf {sycl::range<1> {memory == S_BUFFER ? total_sites : 1}};
+  sycl::buffer<su3_matrix, 1> b_buf {sycl::range<1> {4}};
+  sycl::buffer<site, 1>       c_buf {sycl::range<1> {memory == S_BUFFER ? total_sites : 1}};
+  site *d_a = NULL, *d_c = NULL;
+  su3_matrix *d_b = NULL;
+
+  if (memory == S_BUFFER) {
+    queue.submit([&](sycl::handler& cgh) {
+      sycl::accessor acc {a_buf, cgh, sycl::write_only, sycl::no_init};
+      cgh.copy(a.data(), acc);
+    });
+    queue.submit([&](sycl::handler& cgh) {
+      sycl::accessor acc {b_buf, cgh, sycl::write_only, sycl::no_init};
+      cgh.copy(b.data(), acc);
+    });
+    queue.wait();
+  } else {
+    sycl::usm::alloc kind = memory == S_DEVICE ? sycl::usm::alloc::device :
+                            memory == S_SHARED ? sycl::usm::alloc::shared : sycl::usm::alloc::host;
+    d_a = sycl::malloc<site>(total_sites, queue, kind);
+    d_b = sycl::malloc<su3_matrix>(4, queue, kind);
+    d_c = sycl::malloc<site>(total_sites, queue, kind);
+    if (d_a == NULL || d_b == NULL || d_c == NULL) {
+      std::cout << "Unable to allocate " << memory_names[memory] << " memory " << std::endl;
+      exit(1);
+    }
+
+    // Move host side memory to the allocations
+    queue.memcpy(d_a, a.data(), total_sites * sizeof(site));
+    queue.memcpy(d_b, b.data(), 4 * sizeof(su3_matrix));
+    if (memory == S_SHARED) {
+      queue.prefetch(d_a, total_sites * sizeof(site));
+      queue.prefetch(d_b, 4 * sizeof(su3_matrix));
+      queue.prefetch(d_c, total_sites * sizeof(site));
+    }
+    queue.wait();
+  }
+
+  profile->host_to_device_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("host_to_device", ttrace);
+
+  // create a command_group to issue commands
+  auto submit = [&]() {
+    queue.submit([&](sycl::handler& cgh) {
+      // Lambda functions define the kernel scope
+      if (memory == S_BUFFER) {
+        sycl::accessor a_acc {a_buf, cgh, sycl::read_only};
+        sycl::accessor b_acc {b_buf, cgh, sycl::read_only};
+        sycl::accessor c_acc {c_buf, cgh, sycl::write_only, sycl::no_init};
+        if (kernel == S_NDRANGE)
+          cgh.parallel_for<class k_mat_nn_buffer_nd>(
+          sycl::nd_range<1> {total_wi, wgsize}, [=](sycl::nd_item<1> item) {
+            k_mat_nn(&a_acc[0], &b_acc[0], &c_acc[0], item.get_global_id(0), total_sites);
+          });
+        else
+          cgh.parallel_for<class k_mat_nn_buffer_range>(
+          sycl::range<1> {total_wi}, [=](sycl::id<1> id) {
+            k_mat_nn(&a_acc[0], &b_acc[0], &c_acc[0], id[0], total_sites);
+          });
+      } else {
+        if (kernel == S_NDRANGE)
+          cgh.parallel_for<class k_mat_nn_usm_nd>(
+          sycl::nd_range<1> {total_wi, wgsize}, [=](sycl::nd_item<1> item) {
+            k_mat_nn(d_a, d_b, d_c, item.get_global_id(0), total_sites);
+          });
+        else
+          cgh.parallel_for<class k_mat_nn_usm_range>(
+          sycl::range<1> {total_wi}, [=](sycl::id<1> id) {
+            k_mat_nn(d_a, d_b, d_c, id[0], total_sites);
+          });
+      }
     });   // end of command group
+  };
+
+  double ttotal;
+  if (latency_samples != nullptr) {
+    // launch latency measurement
+    for (size_t iters=0; iters<warmups; ++iters)
+      submit();
+    queue.wait();
+
+    latency_samples->resize(iterations);
+    for (size_t iters=0; iters<iterations; ++iters) {
+      auto tlaunch = Clock::now();
+      submit();
+      queue.wait();
+      (*latency_samples)[iters] = std::chrono::duration<double>(Clock::now()-tlaunch).count();
+    }
+
+    auto tasync = Clock::now();
+    for (size_t iters=0; iters<iterations; ++iters)
+      submit();
+    queue.wait();
+    latency_async = std::chrono::duration<double>(Clock::now()-tasync).count();
+    profile->kernel_time = latency_async;
+    ttotal = latency_async * 1.0e6;
+  } else {
+    // benchmark loop
+    auto tstart = Clock::now();
+    tprofiling = tstart;
+    for (size_t iters=0; iters<iterations+warmups; ++iters) {
+      TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+      if (iters == warmups) {
+        queue.wait();
+        tstart = Clock::now();
+        tprofiling = tstart;
+      }
+      submit();
+      queue.wait();
+    } // end of iteration loop
+
+    ttotal = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tstart).count();
+    profile->kernel_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  }
+
+  // Move the result back to the host side vector
+  tprofiling = Clock::now();
+  ttrace = trace_now();
+  if (memory == S_BUFFER) {
+    queue.submit([&](sycl::handler& cgh) {
+      sycl::accessor acc {c_buf, cgh, sycl::read_only};
+      cgh.copy(acc, c.data());
+    });
+  } else {
+    queue.memcpy(c.data(), d_c, total_sites * sizeof(site));
+  }
   queue.wait();
-  } // end of iteration loop
+  profile->device_to_host_time = (std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tprofiling).count())/1.0e6;
+  trace_record("device_to_host", ttrace);
 
-  double ttotal = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-tstart).count();
+  if (memory != S_BUFFER) {
+    sycl::free(d_a, queue);
+    sycl::free(d_b, queue);
+    sycl::free(d_c, queue);
+  }
 
   return (ttotal /= 1.0e6);
 } // end of SYCL block
+
+// Launch latency measurement, returns the time to submit all iterations before
+// a single wait and fills latency with the time of each waited launch
+double su3_mat_nn_latency(const std::vector<site> &a, const std::vector<su3_matrix> &b, std::vector<site> &c,
+              const size_t total_sites, const size_t iterations, size_t wgsize, const int target,
+              std::vector<double> &latency)
+{
+  Profile profile;
+  latency_samples = &latency;
+  su3_mat_nn(a, b, c, total_sites, iterations, wgsize, target, &profile);
+  latency_samples = nullptr;
+  return latency_async;
+}
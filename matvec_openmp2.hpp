@@ -0,0 +1,170 @@
+#ifndef _MATVEC_OPENMP2_HPP
+#define _MATVEC_OPENMP2_HPP
+// Multiple right hand side matrix-vector mode
+//*******************  m_mv_s_4dir.c  (in su3.a) *****************************
+//  void mult_su3_mat_vec_sum_4dir( su3_matrix *a, su3_vector *b0,
+//	su3_vector *b1, su3_vector *b2, su3_vector *b3, su3_vector *c )
+//  Multiply the elements of an array of four su3_matrices by the
+//  four su3_vectors, and add the results to produce a single su3_vector.
+//  C  <-  A[0]*B0 + A[1]*B1 + A[2]*B2 + A[3]*B3
+//
+// Each site applies its four links to nrhs sets of four source vectors.  The
+// vectors are stored with the right hand side index fastest,
+//   src[site][dir][color][rhs], dst[site][color][rhs]
+// so each link element is loaded once and applied to all right hand sides in a
+// unit stride inner loop.  Without -r the mode steps nrhs through 1, 2, 4, 8
+// and 16 to show how the arithmetic intensity and GFLOP/s scale.
+#include <omp.h>
+
+#ifndef MATVEC_MAX_NRHS
+#  define MATVEC_MAX_NRHS 16
+#endif
+
+template <int NRHS>
+static void k_mat_vec_sum_4dir(const site *a, const Complx *src, Complx *dst, size_t total_sites)
+{
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i) {
+    Complx acc[3][NRHS];
+    for (int k = 0; k < 3; ++k)
+      for (int r = 0; r < NRHS; ++r)
+        acc[k][r] = Complx{0.0, 0.0};
+    for (int j = 0; j < 4; ++j) {
+      const Complx *v = src + (i*4 + j)*3*NRHS;
+      for (int k = 0; k < 3; ++k)
+        for (int m = 0; m < 3; ++m) {
+          const Complx u = a[i].link[j].e[k][m];
+          #pragma omp simd
+          for (int r = 0; r < NRHS; ++r) {
+#ifdef MILC_COMPLEX
+            CMULSUM(u, v[m*NRHS + r], acc[k][r]);
+#else
+            acc[k][r] += u * v[m*NRHS + r];
+#endif
+          }
+        }
+    }
+    Complx *w = dst + i*3*NRHS;
+    for (int k = 0; k < 3; ++k)
+      for (int r = 0; r < NRHS; ++r)
+        w[k*NRHS + r] = acc[k][r];
+  }
+}
+
+// runs iterations+warmups calls of the kernel instantiated for nrhs
+template <int NRHS>
+static double time_mat_vec(int nrhs, const site *a, const Complx *src, Complx *dst,
+                           size_t total_sites, size_t iterations)
+{
+  if (nrhs != NRHS)
+    return time_mat_vec<NRHS-1>(nrhs, a, src, dst, total_sites, iterations);
+  auto tstart = Clock::now();
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    if (iters == warmups)
+      tstart = Clock::now();
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    k_mat_vec_sum_4dir<NRHS>(a, src, dst, total_sites);
+  }
+  return std::chrono::duration<double>(Clock::now()-tstart).count();
+}
+template <>
+inline double time_mat_vec<0>(int, const site *, const Complx *, Complx *, size_t, size_t)
+{
+  return 0.0;
+}
+
+// compares dst with a straightforward evaluation of the sum over the four links
+static bool verify_mat_vec(const std::vector<site> &a, const std::vector<Complx> &src,
+                           const std::vector<Complx> &dst, size_t total_sites, int nrhs)
+{
+  // twelve products of magnitude up to one per element
+  const double tol = std::max(1E-6, 48.0 * std::numeric_limits<Real>::epsilon());
+  for (size_t i = 0; i < total_sites; ++i)
+    for (int r = 0; r < nrhs; ++r)
+      for (int k = 0; k < 3; ++k) {
+        Complx cc = {0.0, 0.0};
+        for (int j = 0; j < 4; ++j)
+          for (int m = 0; m < 3; ++m) {
+#ifdef MILC_COMPLEX
+            CMULSUM(a[i].link[j].e[k][m], src[((i*4 + j)*3 + m)*nrhs + r], cc);
+#else
+            cc += a[i].link[j].e[k][m] * src[((i*4 + j)*3 + m)*nrhs + r];
+#endif
+          }
+        const Complx w = dst[(i*3 + k)*nrhs + r];
+#ifdef MILC_COMPLEX
+        if (!almost_equal(w.real, cc.real, tol) || !almost_equal(w.imag, cc.imag, tol))
+#else
+        if (!almost_equal(w, cc, tol))
+#endif
+          return false;
+      }
+  return true;
+}
+
+int run_matvec(const size_t dims[4], size_t iterations, int nrhs)
+{
+  if (nrhs < 0 || nrhs > MATVEC_MAX_NRHS) {
+    fprintf(stderr, "ERROR: The number of right hand sides must be between 1 and %d\n", MATVEC_MAX_NRHS);
+    return EXIT_FAILURE;
+  }
+  std::vector<int> steps;
+  if (nrhs > 0)
+    steps.push_back(nrhs);
+  else
+    for (int r = 1; r <= MATVEC_MAX_NRHS; r *= 2)
+      steps.push_back(r);
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  const int max_nrhs = *std::max_element(steps.begin(), steps.end());
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  first_touch(a.data(), b.data(), NULL, total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  // complex links that differ between sites, directions and elements
+  make_check_links(a.data(), b.data(), total_sites);
+
+  // the vectors are sized for the largest nrhs and reused
+  std::vector<Complx> src(total_sites*4*3*max_nrhs);
+  std::vector<Complx> dst(total_sites*3*max_nrhs);
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+    printf("%6s %12s %12s %12s %14s\n", "nrhs", "flop/byte", "GFLOP/s", "GByte/s", "us_per_rhs");
+  }
+
+  bool result = true;
+  for (int n : steps) {
+    // source vector values vary with the site, direction, color and right hand
+    // side, so a swapped index in the layout changes the result
+    #pragma omp parallel for
+    for (size_t i = 0; i < total_sites; ++i) {
+      for (size_t e = 0; e < 4*3; ++e)
+        for (int r = 0; r < n; ++r)
+          src[(i*4*3 + e)*n + r] = Complx{(Real)((i + 5*e + 3*r) % 11) / 11,
+                                          (Real)((3*i + e + 7*r) % 5) / 5 - (Real)0.5};
+      for (size_t e = 0; e < (size_t)(3*n); ++e)
+        dst[i*3*n + e] = Complx{0.0, 0.0};
+    }
+
+    const double ttotal = time_mat_vec<MATVEC_MAX_NRHS>(n, a.data(), src.data(), dst.data(), total_sites, iterations);
+    result = result && verify_mat_vec(a, src, dst, total_sites, n);
+
+    // each link is read once per site, each right hand side adds four sources and one result
+    // each complex multiply-add is 8 flops: 4 links * 3 rows * 3 columns * 8 per rhs
+    const double flops = 288.0 * n * total_sites;
+    const double bytes = ((double)sizeof(site) + n * 5.0 * sizeof(su3_vector)) * total_sites;
+    printf("%6d %12.3f %12.3f %12.3f %14.3f\n", n, flops / bytes,
+           iterations * flops / ttotal / 1.0e9, iterations * bytes / ttotal / 1.0e9,
+           ttotal / iterations / n * 1.0e6);
+  }
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _MATVEC_OPENMP2_HPP
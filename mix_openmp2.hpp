@@ -0,0 +1,281 @@
+#ifndef _MIX_OPENMP2_HPP
+#define _MIX_OPENMP2_HPP
+// Application mix mode
+// Replays the kernel profile of a trajectory, read from the -F file.  Each line
+// names a kernel, its number of calls per trajectory and optionally the lattice,
+//   # kernel  calls  [L | nx,ny,nz,nt]
+//   nn        40     16,16,16,32
+//   hmc       10
+// the lattice defaulting to the -l/-L lattice.  The kernels are
+//   nn         C = A*B, mult_su3_nn on every link           bandwidth bound
+//   na         C = A*adj(B), mult_su3_na on every link      bandwidth bound
+//   matvec     sum of the four links times vectors          bandwidth bound
+//   convert    copy of the links of the sites to a bare link field
+//   plaq       average plaquette, a global reduction
+//   timeslice  sum of Re Tr(A B) over every timeslice
+//   smear      one APE pass, six staples per link           compute bound
+//   hmc        U = exp(eps H) U with the Cayley-Hamilton exponential
+// Every trajectory runs the lines in order, each kernel called its number of
+// times in a row.  The time to solution is the mean time of a trajectory, and
+// the breakdown gives the time per call and the share of every line.  Without
+// -F the built-in MIX_PROFILE is used, and with -c the breakdown is also
+// written to a csv file.
+//   -F profile file
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <array>
+#include <omp.h>
+#include "matvec_openmp2.hpp"
+#include "plaq_openmp2.hpp"
+#include "smear_openmp2.hpp"
+#include "hmc_openmp2.hpp"
+#include "timeslice_openmp2.hpp"
+
+// an illustrative trajectory of ten molecular dynamics steps
+#ifndef MIX_PROFILE
+#  define MIX_PROFILE "hmc 10\nnn 40\nna 40\nconvert 20\nmatvec 200\nsmear 4\nplaq 11\ntimeslice 1\n"
+#endif
+#ifndef MIX_STEP
+#  define MIX_STEP 0.01  // step size of the hmc kernel
+#endif
+
+enum MixKernel { MIX_NN, MIX_NA, MIX_MATVEC, MIX_CONVERT, MIX_PLAQ, MIX_TIMESLICE, MIX_SMEAR, MIX_HMC };
+static const char *mix_names[] = {"nn", "na", "matvec", "convert", "plaq", "timeslice", "smear", "hmc"};
+
+// the fields of one lattice of the profile, shared by all its lines
+struct MixLattice {
+  size_t dims[4];
+  size_t total_sites;
+  std::vector<site> a, c;
+  std::vector<su3_matrix> b, links;
+  std::vector<anti_hermitmat> mom;
+  std::vector<Complx> src, dst;
+  std::vector<double> partial, tpartial, corr;
+};
+
+struct MixLine {
+  MixKernel kernel;
+  size_t calls;
+  size_t lattice;  // index into the lattices
+  double time = 0.0;
+};
+
+static void make_mix_lattice(MixLattice &l, const size_t dims[4])
+{
+  std::copy(dims, dims + 4, l.dims);
+  const size_t total_sites = l.total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  l.a.resize(total_sites);
+  l.c.resize(total_sites);
+  l.b.resize(4);
+  l.links.resize(4 * total_sites);
+  l.mom.resize(4 * total_sites);
+  l.src.resize(4 * 3 * total_sites);
+  l.dst.resize(3 * total_sites);
+  l.partial.resize(reduce_blocks(total_sites));
+  l.tpartial.resize(timeslice_scratch(dims[3], total_sites / dims[3]));
+  l.corr.resize(dims[3]);
+  first_touch(l.a.data(), l.b.data(), l.c.data(), total_sites);
+  first_touch_links(l.links.data(), 4 * total_sites);
+  make_gauge(l.a.data(), dims, HMC_EPS);
+  init_link(l.b.data(), Complx{1.0/3.0,0.0});
+  make_momenta(l.mom.data(), total_sites);
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i) {
+    for (size_t k = 12*i; k < 12*(i + 1); ++k)
+      l.src[k] = Complx{1.0, 0.0};
+    for (size_t k = 3*i; k < 3*(i + 1); ++k)
+      l.dst[k] = Complx{0.0, 0.0};
+  }
+}
+
+// parses the profile, adding a lattice for every new lattice size
+static bool parse_profile(std::istream &in, const size_t dims[4], std::vector<MixLine> &lines,
+                          std::vector<std::array<size_t,4>> &lattices)
+{
+  std::string text;
+  for (size_t n = 1; std::getline(in, text); ++n) {
+    std::istringstream fields(text.substr(0, text.find('#')));
+    std::string name, calls, lattice, extra;
+    MixLine line;
+    if (!(fields >> name))
+      continue;
+    int k = MIX_NN;
+    while (k <= MIX_HMC && name != mix_names[k])
+      ++k;
+    if (k > MIX_HMC) {
+      fprintf(stderr, "ERROR: Unknown kernel %s on line %zu of the profile\n", name.c_str(), n);
+      return false;
+    }
+    line.kernel = (MixKernel)k;
+    if (!(fields >> calls)) {
+      fprintf(stderr, "ERROR: Missing call count on line %zu of the profile\n", n);
+      return false;
+    }
+    // a positive decimal count, read without the sign and wraparound of >> size_t
+    errno = 0;
+    line.calls = calls.find_first_not_of("0123456789") == std::string::npos ? strtoull(calls.c_str(), NULL, 10) : 0;
+    if (line.calls == 0 || errno == ERANGE) {
+      fprintf(stderr, "ERROR: Bad call count %s on line %zu of the profile\n", calls.c_str(), n);
+      return false;
+    }
+    std::array<size_t,4> d = {dims[0], dims[1], dims[2], dims[3]};
+    if (fields >> lattice) {
+      // a single extent L or exactly four, nx,ny,nz,nt, and nothing after them
+      int end = 0;
+      if (lattice.find(',') == std::string::npos) {
+        if (sscanf(lattice.c_str(), "%zu%n", &d[0], &end) == 1)
+          d[1] = d[2] = d[3] = d[0];
+      } else {
+        sscanf(lattice.c_str(), "%zu,%zu,%zu,%zu%n", &d[0], &d[1], &d[2], &d[3], &end);
+      }
+      if (end != (int)lattice.size() || lattice.find_first_not_of("0123456789,") != std::string::npos
+      ||  d[0] == 0 || d[1] == 0 || d[2] == 0 || d[3] == 0) {
+        fprintf(stderr, "ERROR: Bad lattice %s on line %zu of the profile\n", lattice.c_str(), n);
+        return false;
+      }
+    }
+    if (fields >> extra) {
+      fprintf(stderr, "ERROR: Unexpected %s on line %zu of the profile\n", extra.c_str(), n);
+      return false;
+    }
+    line.lattice = std::find(lattices.begin(), lattices.end(), d) - lattices.begin();
+    if (line.lattice == lattices.size())
+      lattices.push_back(d);
+    lines.push_back(line);
+  }
+  return true;
+}
+
+// one call of a kernel
+static void mix_call(MixKernel kernel, MixLattice &l)
+{
+  const size_t total_sites = l.total_sites;
+  double tsites = 0.0, tcombine = 0.0;
+  switch (kernel) {
+  case MIX_NN:
+    k_mat_nn(l.a.data(), l.b.data(), site_links{l.c.data()}, total_sites);
+    break;
+  case MIX_NA:
+    k_mult_su3<MULT_NA>(l.a.data(), l.b.data(), l.c.data(), total_sites);
+    break;
+  case MIX_MATVEC:
+    k_mat_vec_sum_4dir<1>(l.a.data(), l.src.data(), l.dst.data(), total_sites);
+    break;
+  case MIX_CONVERT:
+    #pragma omp parallel for
+    for (size_t i = 0; i < total_sites; ++i)
+      for (int mu = 0; mu < 4; ++mu)
+        l.links[4*i + mu] = l.a[i].link[mu];
+    break;
+  case MIX_PLAQ:
+    l.corr[0] = plaquette(l.a.data(), l.partial.data(), total_sites, l.dims, tsites, tcombine);
+    break;
+  case MIX_TIMESLICE:
+    timeslice_sum(TIMESLICE_TWOLEVEL, l.a.data(), l.b.data(), l.dims[3], total_sites / l.dims[3],
+                  l.tpartial.data(), l.corr.data());
+    break;
+  case MIX_SMEAR:
+    smear_pass(l.a.data(), l.c.data(), total_sites, l.dims, SMEAR_APE, 0.5, false);
+    break;
+  case MIX_HMC:
+    k_hmc_update(l.a.data(), l.mom.data(), total_sites, MIX_STEP, 0);
+    break;
+  }
+}
+
+int run_mix(const size_t dims[4], size_t iterations, const std::string &profile_filename,
+            const std::string &csv_filename)
+{
+  std::vector<MixLine> lines;
+  std::vector<std::array<size_t,4>> sizes;
+  if (profile_filename != "") {
+    std::ifstream in(profile_filename);
+    if (!in) {
+      fprintf(stderr, "ERROR: Cannot open the profile %s\n", profile_filename.c_str());
+      return EXIT_FAILURE;
+    }
+    if (!parse_profile(in, dims, lines, sizes))
+      return EXIT_FAILURE;
+  } else {
+    std::istringstream in(MIX_PROFILE);
+    parse_profile(in, dims, lines, sizes);
+  }
+  if (lines.empty()) {
+    fprintf(stderr, "ERROR: The profile lists no kernels\n");
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Mix mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  std::vector<MixLattice> lattices(sizes.size());
+  for (size_t n = 0; n < sizes.size(); ++n)
+    make_mix_lattice(lattices[n], sizes[n].data());
+
+  if (verbose >= 1) {
+    printf("Profile %s, %zu lines on %zu lattices\n", profile_filename != "" ? profile_filename.c_str() : "built-in",
+           lines.size(), lattices.size());
+    printf("Executing %zu trajectories with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+  }
+
+  bool result = true;
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    for (MixLine &line : lines) {
+      MixLattice &l = lattices[line.lattice];
+      TRACE_ZONE(mix_names[line.kernel]);
+      auto tstart = Clock::now();
+      for (size_t n = 0; n < line.calls; ++n)
+        mix_call(line.kernel, l);
+      if (iters >= warmups)
+        line.time += std::chrono::duration<double>(Clock::now()-tstart).count();
+      // the products are checked against the links they were formed from
+      if (iters == 0 && line.calls > 0) {
+        if (line.kernel == MIX_NN)
+          result = verify_mat_nn(l.a, l.b, l.c, l.total_sites) && result;
+        else if (line.kernel == MIX_NA)
+          result = verify_mult(l.a, l.b, l.c, l.total_sites, MULT_NA, 1) && result;
+        else if (line.kernel == MIX_PLAQ && !(l.corr[0] > 0.0 && l.corr[0] <= 1.0 + 1E-5)) {
+          fprintf(stderr, "Plaquette %g out of range\n", l.corr[0]);
+          result = false;
+        }
+      }
+    }
+  }
+
+  double total = 0.0;
+  for (const MixLine &line : lines)
+    total += line.time / iterations;
+  FILE *output = NULL;
+  if (csv_filename != "") {
+    output = fopen(csv_filename.c_str(), "w");
+    fprintf(output, "kernel,lattice,calls,ms_per_call,ms_per_trajectory,share\n");
+  }
+  printf("%10s %16s %8s %12s %12s %8s\n", "kernel", "lattice", "calls", "ms_per_call", "ms_per_traj", "share");
+  for (const MixLine &line : lines) {
+    const size_t *d = lattices[line.lattice].dims;
+    char lattice[64];
+    snprintf(lattice, sizeof(lattice), "%zux%zux%zux%zu", d[0], d[1], d[2], d[3]);
+    const double t = line.time / iterations;
+    const double per_call = line.calls > 0 ? t / line.calls : 0.0;
+    printf("%10s %16s %8zu %12.4f %12.3f %7.1f%%\n", mix_names[line.kernel], lattice, line.calls,
+           per_call * 1.0e3, t * 1.0e3, 100.0 * t / total);
+    if (output != NULL)
+      fprintf(output, "%s,%s,%zu,%f,%f,%f\n", mix_names[line.kernel], lattice, line.calls,
+              per_call * 1.0e3, t * 1.0e3, t / total);
+  }
+  if (output != NULL)
+    fclose(output);
+  printf("Time to solution = %.3f ms per trajectory\n", total * 1.0e3);
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _MIX_OPENMP2_HPP
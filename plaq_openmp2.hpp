@@ -0,0 +1,107 @@
+#ifndef _PLAQ_OPENMP2_HPP
+#define _PLAQ_OPENMP2_HPP
+// Plaquette mode
+// Computes the average plaquette over the six planes mu<nu at every site,
+//   P = 1/(6 V) sum_x sum_mu<nu 1/3 Re Tr( U_mu(x) U_nu(x+mu) U_mu^+(x+nu) U_nu^+(x) )
+// evaluated as in MILC's plaquette() with two products and a realtrace_su3.
+// The links of the neighbours are gathered with periodic boundaries.  The sum
+// uses the deterministic block reduction of reduce_openmp2.hpp, so the result is
+// bit-identical for any number of threads; the mode checks this by repeating the
+// sum on a single thread.  The time of the final tree combine is reported apart
+// from the site loop.
+#include <cstring>
+#include <omp.h>
+#include "reduce_openmp2.hpp"
+
+// sum over the six planes of Re Tr at site i, in double
+static inline double site_plaquette(const site *a, size_t i, const size_t dims[4])
+{
+  double sum = 0.0;
+  for (int mu = 0; mu < 3; ++mu) {
+    const site &xmu = a[neighbor(a[i], mu, 1, dims)];
+    for (int nu = mu + 1; nu < 4; ++nu) {
+      const site &xnu = a[neighbor(a[i], nu, 1, dims)];
+      su3_matrix tmp1, tmp2;
+      mult_su3_nn(&a[i].link[mu], &xmu.link[nu], &tmp1);
+      mult_su3_nn(&a[i].link[nu], &xnu.link[mu], &tmp2);
+      sum += realtrace_su3(&tmp1, &tmp2);
+    }
+  }
+  return sum;
+}
+
+// average plaquette, the site loop and combine times are added to tsites and tcombine
+static double plaquette(const site *a, double *partial, size_t total_sites, const size_t dims[4],
+                        double &tsites, double &tcombine)
+{
+  auto t0 = Clock::now();
+  block_partials(total_sites, partial, [&](size_t i) { return site_plaquette(a, i, dims); });
+  auto t1 = Clock::now();
+  const double sum = tree_sum(partial, reduce_blocks(total_sites));
+  auto t2 = Clock::now();
+  tsites += std::chrono::duration<double>(t1-t0).count();
+  tcombine += std::chrono::duration<double>(t2-t1).count();
+  return sum / (3.0 * 6.0 * total_sites);
+}
+
+int run_plaq(const size_t dims[4], size_t iterations)
+{
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  first_touch(a.data(), b.data(), NULL, total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  std::vector<double> partial(reduce_blocks(total_sites));
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+    printf("Reduction over %zu blocks of %d sites\n", partial.size(), REDUCE_BLOCK);
+  }
+
+  double plaq = 0.0, tsites = 0.0, tcombine = 0.0;
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    if (iters == warmups)
+      tsites = tcombine = 0.0;
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    plaq = plaquette(a.data(), partial.data(), total_sites, dims, tsites, tcombine);
+  }
+  const double ttotal = tsites + tcombine;
+
+  // repeat on one thread, the result must not change in any bit
+  const int threads = omp_get_max_threads();
+  double tdummy = 0.0, plaq1;
+  omp_set_num_threads(1);
+  plaq1 = plaquette(a.data(), partial.data(), total_sites, dims, tdummy, tdummy);
+  omp_set_num_threads(threads);
+
+  // six planes, each two matrix products of 3*3*3 complex multiply-adds and a 36 flop trace
+  const double flops = 6.0 * (2*216 + 36) * total_sites;
+  // each site reads its own 4 links and 12 from its neighbours
+  const double gathered = 16.0 * sizeof(su3_matrix) * total_sites;
+  const double unique = (double)sizeof(site) * total_sites;
+  printf("Plaquette = %.17g\n", plaq);
+  printf("Total GFLOP/s = %.3f\n", iterations * flops / ttotal / 1.0e9);
+  printf("Total GByte/s (GB/s) = %.3f gathered, %.3f unique\n",
+         iterations * gathered / ttotal / 1.0e9, iterations * unique / ttotal / 1.0e9);
+  printf("Combine time = %.3f us per iteration, %.2f%% of the total\n",
+         iterations > 0 ? tcombine / iterations * 1.0e6 : 0.0, ttotal > 0.0 ? 100.0 * tcombine / ttotal : 0.0);
+
+  bool result = memcmp(&plaq, &plaq1, sizeof(double)) == 0;
+  if (!result)
+    fprintf(stderr, "Plaquette %.17g on %d threads differs from %.17g on 1 thread\n", plaq, threads, plaq1);
+#ifndef RANDOM_INIT
+  // with every link element 1, U U = 3 U and Re Tr(9 U^+ 3 U)/3 = 27
+  if (!almost_equal(plaq, 27.0, 1E-6)) {
+    fprintf(stderr, "Plaquette %.17g differs from the expected 27\n", plaq);
+    result = false;
+  }
+#endif
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _PLAQ_OPENMP2_HPP
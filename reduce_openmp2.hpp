@@ -0,0 +1,50 @@
+#ifndef _REDUCE_OPENMP2_HPP
+#define _REDUCE_OPENMP2_HPP
+// Deterministic parallel reductions
+// The sites are split into fixed blocks of REDUCE_BLOCK sites.  Each block is
+// summed in site order into its own partial, whichever thread runs it, and the
+// partials are combined by a pairwise tree in a fixed order.  The result is
+// therefore bit-identical for any number of threads, unlike per-thread partials
+// or an OpenMP reduction clause whose grouping follows the thread count.
+#include <omp.h>
+
+#ifndef REDUCE_BLOCK
+#  define REDUCE_BLOCK 256
+#endif
+
+static inline size_t reduce_blocks(size_t total_sites)
+{
+  return (total_sites + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+}
+
+// partial[b] = sum of f(i) over block b, in site order
+template <class F>
+static void block_partials(size_t total_sites, double *partial, F f)
+{
+  const size_t blocks = reduce_blocks(total_sites);
+  #pragma omp parallel for schedule(static)
+  for (size_t blk = 0; blk < blocks; ++blk) {
+    double sum = 0.0;
+    const size_t end = std::min(total_sites, (blk + 1) * REDUCE_BLOCK);
+    for (size_t i = blk * REDUCE_BLOCK; i < end; ++i)
+      sum += f(i);
+    partial[blk] = sum;
+  }
+}
+
+// pairwise tree combine of n partials, overwriting them, returns the total
+static double tree_sum(double *partial, size_t n)
+{
+  for (size_t stride = 1; stride < n; stride *= 2) {
+    const size_t pairs = (n + 2*stride - 1) / (2*stride);
+    #pragma omp parallel for schedule(static) if (pairs > 1024)
+    for (size_t p = 0; p < pairs; ++p) {
+      const size_t i = p * 2 * stride;
+      if (i + stride < n)
+        partial[i] += partial[i + stride];
+    }
+  }
+  return n > 0 ? partial[0] : 0.0;
+}
+
+#endif  // _REDUCE_OPENMP2_HPP
@@ -0,0 +1,179 @@
+#ifndef _SMEAR_OPENMP2_HPP
+#define _SMEAR_OPENMP2_HPP
+// Link smearing mode
+// Every pass replaces each link by a smeared link built from its six staples C,
+//   ape    U' = (1 - alpha) U + alpha/6 C
+//   stout  U' = exp(A) U,  A the traceless anti-hermitian part of rho C U^+
+// All links of a pass are computed from the previous field, so the passes
+// alternate between a and c as source and destination.  With -R every smeared
+// link is projected back onto SU(3); APE needs this to stay in the group, stout
+// only to remove the truncation error of the exponential.
+//   -S ape|stout[,weight]  -N passes  -R
+// The links start near the identity (SMEAR_EPS) so the smoothing shows as a rise
+// of the plaquette, which the mode checks together with the unitarity.
+#include <omp.h>
+#include "gauge_openmp2.hpp"
+#include "plaq_openmp2.hpp"
+
+#ifndef SMEAR_EPS
+#  define SMEAR_EPS 0.5  // roughness of the starting field
+#endif
+
+enum SmearKind { SMEAR_APE, SMEAR_STOUT };
+
+// parses ape|stout[,weight], the weight defaults to alpha = 0.5 or rho = 0.1
+static bool parse_smear(const std::string &spec, SmearKind &kind, double &weight)
+{
+  const std::string name = spec.substr(0, spec.find(','));
+  if (name == "ape")
+    kind = SMEAR_APE;
+  else if (name == "stout")
+    kind = SMEAR_STOUT;
+  else
+    return false;
+  weight = spec.find(',') != std::string::npos ? atof(spec.substr(spec.find(',') + 1).c_str())
+         : kind == SMEAR_APE ? 0.5 : 0.1;
+  return weight > 0.0;
+}
+
+// one smearing pass of every link of src into dst
+static void smear_pass(const site *src, site *dst, size_t total_sites, const size_t dims[4],
+                       SmearKind kind, Real weight, bool reunit)
+{
+  #pragma omp parallel for
+  for (size_t i = 0; i < total_sites; ++i) {
+    for (int mu = 0; mu < 4; ++mu) {
+      su3_matrix stp, tmp1, tmp2;
+      site_staple(src, i, mu, dims, &stp);
+      if (kind == SMEAR_APE) {
+        scalar_mult_su3_matrix(&src[i].link[mu], 1 - weight, &tmp1);
+        scalar_mult_add_su3_matrix(&tmp1, &stp, weight / 6, &dst[i].link[mu]);
+      } else {
+        scalar_mult_su3_matrix(&stp, weight, &tmp1);
+        mult_su3_na(&tmp1, &src[i].link[mu], &tmp2);
+        make_anti_hermitian(&tmp2, &tmp1);
+        exp_su3_taylor(&tmp1, SU3_EXP_ORDER, &tmp2);
+        mult_su3_nn(&tmp2, &src[i].link[mu], &dst[i].link[mu]);
+      }
+      if (reunit)
+        reunit_su3(&dst[i].link[mu]);
+    }
+  }
+}
+
+// true when every element of the links is a finite number
+static bool links_finite(const site *s, size_t total_sites)
+{
+  bool finite = true;
+  #pragma omp parallel for reduction(&&:finite)
+  for (size_t i = 0; i < total_sites; ++i)
+    for (int j = 0; j < 4; ++j)
+      for (int k = 0; k < 3; ++k)
+        for (int l = 0; l < 3; ++l)
+          finite = finite && std::isfinite(CREAL(s[i].link[j].e[k][l])) && std::isfinite(CIMAG(s[i].link[j].e[k][l]));
+  return finite;
+}
+
+int run_smear(const size_t dims[4], size_t iterations, const std::string &smear, int passes, bool reunit)
+{
+  SmearKind kind;
+  double weight;
+  if (!parse_smear(smear, kind, weight)) {
+    fprintf(stderr, "ERROR: Unknown smearing %s (ape|stout[,weight])\n", smear.c_str());
+    return EXIT_FAILURE;
+  }
+  if (passes < 1) {
+    fprintf(stderr, "ERROR: Smearing requires at least one pass\n");
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Smearing mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  std::vector<site> u0(total_sites), a(total_sites), c(total_sites);
+  std::vector<su3_matrix> b(4);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  first_touch(u0.data(), b.data(), NULL, total_sites);
+  make_gauge(u0.data(), dims, SMEAR_EPS);
+  // c needs the coordinates of its sites when it is the source of a pass
+  make_lattice(c.data(), dims[0], dims[1], dims[2], dims[3], Complx{0.0,0.0});
+  std::vector<double> partial(reduce_blocks(total_sites));
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations of %d %s passes (weight %g%s) with %zu warmups on %d threads\n",
+           iterations, passes, kind == SMEAR_APE ? "APE" : "stout", weight,
+           reunit ? ", reunitarized" : "", warmups, omp_get_max_threads());
+  }
+
+  // every iteration smears the starting field, copied into a untimed
+  double ttotal = 0.0;
+  site *result = a.data();
+  for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+    std::copy(u0.begin(), u0.end(), a.begin());
+    TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+    auto tstart = Clock::now();
+    site *src = a.data(), *dst = c.data();
+    for (int p = 0; p < passes; ++p) {
+      TRACE_ZONE("smear pass");
+      smear_pass(src, dst, total_sites, dims, kind, (Real)weight, reunit);
+      std::swap(src, dst);
+    }
+    if (iters >= warmups)
+      ttotal += std::chrono::duration<double>(Clock::now()-tstart).count();
+    result = src;
+  }
+  const double npass = (double)iterations * passes;
+
+  // per link: the staples, then the APE combination (36 + 36 flops) or the stout
+  // products, anti-hermitian projection and exponential, and the reunitarization
+  const double link_flops = STAPLE_FLOPS
+                          + (kind == SMEAR_APE ? 72 : 18*2 + 2*216 + 18 + SU3_EXP_ORDER * (216 + 20))
+                          + (reunit ? 150 : 0);
+  const double flops = 4 * link_flops * total_sites;
+  // per link 19 matrices are read, the link itself and three for each staple, and
+  // one is written; the unique traffic reads each site once and writes its links
+  const double gathered = 4 * 20.0 * sizeof(su3_matrix);
+  const double unique = (double)sizeof(site) + 4 * sizeof(su3_matrix);
+
+  double tdummy = 0.0;
+  const double plaq0 = plaquette(u0.data(), partial.data(), total_sites, dims, tdummy, tdummy);
+  const double plaq1 = plaquette(result, partial.data(), total_sites, dims, tdummy, tdummy);
+  const double dev = max_unitarity_deviation(result, total_sites);
+
+  printf("Time per pass = %.3f ms\n", npass > 0 ? ttotal / npass * 1.0e3 : 0.0);
+  printf("Bytes per site per pass = %.0f gathered, %.0f unique\n", gathered, unique);
+  printf("Total GFLOP/s = %.3f\n", npass * flops / ttotal / 1.0e9);
+  printf("Total GByte/s (GB/s) = %.3f gathered, %.3f unique\n",
+         npass * gathered * total_sites / ttotal / 1.0e9, npass * unique * total_sites / ttotal / 1.0e9);
+  printf("Plaquette = %.8f before, %.8f after %d passes\n", plaq0, plaq1, passes);
+  printf("Unitarity deviation = %.3e\n", dev);
+
+  // smearing smooths the field, and a field kept in SU(3) must have a higher plaquette;
+  // plain APE links leave SU(3), so only their finiteness is checked
+  bool ok = links_finite(result, total_sites);
+  if (!ok)
+    fprintf(stderr, "The smeared links are not finite\n");
+  if (kind == SMEAR_APE && !reunit)
+    printf("Warning: APE links are not reunitarized, use -R to check unitarity and the plaquette\n");
+  else {
+    const double tol = sizeof(Real) == 4 ? 1E-4 : 1E-8;
+    if (dev > tol) {
+      fprintf(stderr, "Unitarity deviation %.3e exceeds %.0e\n", dev, tol);
+      ok = false;
+    }
+    if (!(plaq1 > plaq0)) {
+      fprintf(stderr, "Plaquette did not increase\n");
+      ok = false;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _SMEAR_OPENMP2_HPP
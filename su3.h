@@ -5,6 +5,17 @@
 /* generic precision complex number definition */
 /* specific for float complex */
 
+#ifdef __OPENCL_VERSION__
+/* OpenCL C kernels have no templates, the alignment matches the host side */
+typedef struct __attribute__((aligned(8))) {
+  float real;
+  float imag;
+} fcomplex;
+typedef struct __attribute__((aligned(16))) {
+  double real;
+  double imag;
+} dcomplex;
+#else
 template <typename T> struct alignas(sizeof(T) * 2) complex {
   T real;
   T imag;
@@ -12,6 +23,7 @@ template <typename T> struct alignas(sizeof(T) * 2) complex {
 
 using fcomplex = complex<float>;
 using dcomplex = complex<double>;
+#endif
 
 // typedef struct {
 //   float real;
@@ -28,6 +40,8 @@ typedef struct {
   double device_to_host_time;
   double kernel_time;
   double host_to_device_time;
+  double build_time;  // kernel compile at startup, zero for ahead of time builds
+  double load_time;   // kernel load from a cache
 } Profile;
 
 typedef struct {
@@ -74,5 +88,56 @@ typedef struct {
     (a).real += (b).real;                                                      \
     (a).imag += (b).imag;                                                      \
   }
+/*  c = a + b */
+#define CADD(a, b, c)                                                          \
+  {                                                                            \
+    (c).real = (a).real + (b).real;                                            \
+    (c).imag = (a).imag + (b).imag;                                            \
+  }
+/*  c = a - b */
+#define CSUB(a, b, c)                                                          \
+  {                                                                            \
+    (c).real = (a).real - (b).real;                                            \
+    (c).imag = (a).imag - (b).imag;                                            \
+  }
+/*  b = conj(a) */
+#define CONJG(a, b)                                                            \
+  {                                                                            \
+    (b).real = (a).real;                                                       \
+    (b).imag = -(a).imag;                                                      \
+  }
+/*  c = b * a, b real */
+#define CMULREAL(a, b, c)                                                      \
+  {                                                                            \
+    (c).real = (b) * (a).real;                                                 \
+    (c).imag = (b) * (a).imag;                                                 \
+  }
+/*  c = conj(a) * b */
+#define CMULJ_(a, b, c)                                                        \
+  {                                                                            \
+    (c).real = (a).real * (b).real + (a).imag * (b).imag;                      \
+    (c).imag = (a).real * (b).imag - (a).imag * (b).real;                      \
+  }
+/*  c = a * conj(b) */
+#define CMUL_J(a, b, c)                                                        \
+  {                                                                            \
+    (c).real = (a).real * (b).real + (a).imag * (b).imag;                      \
+    (c).imag = (a).imag * (b).real - (a).real * (b).imag;                      \
+  }
+/*  c += conj(a) * b */
+#define CMULJ_SUM(a, b, c)                                                     \
+  {                                                                            \
+    (c).real += (a).real * (b).real + (a).imag * (b).imag;                     \
+    (c).imag += (a).real * (b).imag - (a).imag * (b).real;                     \
+  }
+/*  c += a * conj(b) */
+#define CMUL_JSUM(a, b, c)                                                     \
+  {                                                                            \
+    (c).real += (a).real * (b).real + (a).imag * (b).imag;                     \
+    (c).imag += (a).imag * (b).real - (a).real * (b).imag;                     \
+  }
+/*  real and imaginary parts */
+#define CREAL(a) ((a).real)
+#define CIMAG(a) ((a).imag)
 
 #endif /* _SU3_H */
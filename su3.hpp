@@ -6,6 +6,8 @@ typedef struct{
   double device_to_host_time;
   double kernel_time;
   double host_to_device_time;
+  double build_time;  // kernel compile at startup, zero for ahead of time builds
+  double load_time;   // kernel load from a cache
 } Profile;
 
 #ifdef USE_THRUST
@@ -53,5 +55,20 @@ typedef struct{
 #endif
 #endif  // PRECISION
 
+// MILC style complex operations, conj() is found by argument dependent lookup
+#define CMULSUM(a, b, c)   { (c) += (a) * (b); }
+#define CMUL(a, b, c)      { (c) = (a) * (b); }
+#define CSUM(a, b)         { (a) += (b); }
+#define CADD(a, b, c)      { (c) = (a) + (b); }
+#define CSUB(a, b, c)      { (c) = (a) - (b); }
+#define CONJG(a, b)        { (b) = conj(a); }
+#define CMULREAL(a, b, c)  { (c) = (b) * (a); }
+#define CMULJ_(a, b, c)    { (c) = conj(a) * (b); }
+#define CMUL_J(a, b, c)    { (c) = (a) * conj(b); }
+#define CMULJ_SUM(a, b, c) { (c) += conj(a) * (b); }
+#define CMUL_JSUM(a, b, c) { (c) += (a) * conj(b); }
+#define CREAL(a)           ((a).real())
+#define CIMAG(a)           ((a).imag())
+
 #endif  // _SU3_HPP
 
@@ -10,8 +10,9 @@
 #include <cmath>
 #include <complex>
 #include <chrono>
+#include <limits>
 typedef std::chrono::system_clock Clock;
-#ifdef USE_OPENMP
+#if defined(USE_OPENMP) || defined(_OPENMP)
   #include <omp.h>
 #endif
 
@@ -21,6 +22,9 @@ typedef std::chrono::system_clock Clock;
 #ifndef LDIM
 #  define LDIM 32       // Lattice size = LDIM^4
 #endif
+#ifndef BATCH_SIZE
+#  define BATCH_SIZE 8  // Lattices in batch mode
+#endif
 #ifndef PRECISION
 #  define PRECISION 2  // 1->single, 2->double
 #endif
@@ -32,7 +36,9 @@ size_t       warmups=1;
 int  g_argc;
 char **g_argv;
 
+#include "trace.hpp"
 #include "lattice.hpp"
+#include "su3_ops.hpp"
 
 // validation function used by main()
 template<class T>
@@ -98,16 +104,20 @@ void init_link(su3_matrix *s, Complx val) {
 }
 
 // initializes a lattice site
-void make_lattice(site *s, size_t n, Complx val) {
-  int nx=n;
-  int ny=n;
-  int nz=n;
-  int nt=n;
-
-  #pragma omp parallel for
-  for(int t=0;t<nt;t++) {
-    int i=t*nz*ny*nx;
-    for(int z=0;z<nz;z++)for(int y=0;y<ny;y++)for(int x=0;x<nx;x++,i++){
+// sites are ordered with x fastest, indexed with 64 bits for very large volumes
+// thread_time, when given, receives the seconds each OpenMP thread spent on its share
+void make_lattice(site *s, size_t nx, size_t ny, size_t nz, size_t nt, Complx val,
+                  double *thread_time = nullptr) {
+  #pragma omp parallel
+  {
+  TRACE_ZONE("make_lattice chunk");
+#ifdef _OPENMP
+  auto tstart = Clock::now();
+#endif
+  #pragma omp for nowait
+  for(size_t t=0;t<nt;t++) {
+    size_t i=t*nz*ny*nx;
+    for(size_t z=0;z<nz;z++)for(size_t y=0;y<ny;y++)for(size_t x=0;x<nx;x++,i++){
       s[i].x=x; s[i].y=y; s[i].z=z; s[i].t=t;
       s[i].index = x+nx*(y+ny*(z+nz*t));
       if( (x+y+z+t)%2 == 0)
@@ -117,6 +127,50 @@ void make_lattice(site *s, size_t n, Complx val) {
       init_link(&s[i].link[0], val);
     }
   }
+#ifdef _OPENMP
+  if (thread_time != nullptr)
+    thread_time[omp_get_thread_num()] = std::chrono::duration<double>(Clock::now()-tstart).count();
+#endif
+  }
+}
+
+// hypercubic n^4 lattice
+void make_lattice(site *s, size_t n, Complx val) {
+  make_lattice(s, n, n, n, n, val);
+}
+
+// Site dependent complex links for A, and for B a phase times a cyclic
+// permutation in every direction, unitary but neither hermitian nor symmetric.
+// The constant fields give the same result for A*B, A*adj(B), adj(A)*B and
+// (A*B)*B, so the checks of the in-place and mult_su3 variants use these.
+void make_check_links(site *a, su3_matrix *b, size_t total_sites) {
+  for(int j=0; j<4; ++j) for(int k=0; k<3; ++k) for(int l=0; l<3; ++l) {
+    const double phase = 0.3*(j + 1) + 0.7*k;
+    b[j].e[k][l] = l == (k + 1 + j%2) % 3 ? Complx{(Real)cos(phase), (Real)sin(phase)} : Complx{0.0, 0.0};
+  }
+  #pragma omp parallel for
+  for(size_t i=0; i<total_sites; ++i)
+    for(int j=0; j<4; ++j) for(int k=0; k<3; ++k) for(int l=0; l<3; ++l)
+      a[i].link[j].e[k][l] = Complx{(Real)((i + 3*j + 5*k + 7*l) % 13) / 13,
+                                    (Real)((2*i + j + 3*k + 2*l) % 7) / 7 - (Real)0.5};
+}
+
+// z = x*y, written out for the checks independently of su3_ops.hpp
+void ref_mult_nn(const su3_matrix &x, const su3_matrix &y, su3_matrix &z) {
+  for(int k=0; k<3; ++k) for(int l=0; l<3; ++l) {
+    Complx cc = {0.0, 0.0};
+    for(int m=0; m<3; ++m)
+      CMULSUM(x.e[k][m], y.e[m][l], cc);
+    z.e[k][l] = cc;
+  }
+}
+
+// index of the neighbour of site s one step in direction dir (0..3 for x,y,z,t),
+// or one step back when sign < 0, with periodic boundaries
+inline size_t neighbor(const site &s, int dir, int sign, const size_t dims[4]) {
+  size_t x[4] = {(size_t)s.x, (size_t)s.y, (size_t)s.z, (size_t)s.t};
+  x[dir] = sign < 0 ? (x[dir] + dims[dir] - 1) % dims[dir] : (x[dir] + 1) % dims[dir];
+  return x[0] + dims[0]*(x[1] + dims[1]*(x[2] + dims[2]*x[3]));
 }
 
 // Include the programming model specific function for su3_mat_nn()
@@ -126,16 +180,16 @@ void make_lattice(site *s, size_t n, Complx val) {
   #include "mat_nn_openmp.hpp"
 #elif  USE_OPENMP_CPU
   #include "mat_nn_openmp2.hpp"
+#elif  USE_BLAS
+  #include "mat_nn_blas.hpp"
 #elif  USE_OPENACC
   #include "mat_nn_openacc.hpp"
 #elif  USE_OPENCL
   // OpenCL 1.2 doesn't support complex data types
   #define MILC_COMPLEX
   #include "mat_nn_opencl.hpp"
-#elif USE_SYCL
+#elif defined(USE_SYCL) || defined(USE_DPCPP)
   #include "mat_nn_sycl.hpp"
-#elif USE_DPCPP
-  #include "mat_nn_dpcpp.hpp"
 #elif USE_HIP
   #include "mat_nn_hip.hpp"
 #elif USE_KOKKOS
@@ -146,12 +200,172 @@ void make_lattice(site *s, size_t n, Complx val) {
   #error Unknown programming model
 #endif
 
+// Verification of C = A*B for the first total_sites sites
+// c_link(i) returns the four output links of site i
+template <class SiteArray, class MatrixArray, class Output>
+bool verify_links(const SiteArray &a, const MatrixArray &b, Output c_link, size_t total_sites)
+{
+  bool result = true;
+  for (size_t i=0;i<total_sites;++i) for(int j=0;j<4;++j)  for(int k=0;k<3;++k)  for(int l=0;l<3;++l) {
+    Complx cc = {0.0, 0.0};
+    for(int m=0;m<3;m++) {
+      #ifdef MILC_COMPLEX
+        CMULSUM( a[i].link[j].e[k][m], b[j].e[m][l], cc)
+      #elif USE_KOKKOS
+        cc += a(i).link[j].e[k][m] * b[j].e[m][l];
+      #else
+        cc += a[i].link[j].e[k][m] * b[j].e[m][l];
+      #endif
+    }
+
+    #ifdef MILC_COMPLEX
+      result = almost_equal(c_link(i)[j].e[k][l].real, cc.real, 1E-6)
+            && almost_equal(c_link(i)[j].e[k][l].imag, cc.imag, 1E-6);
+    #else
+      result = almost_equal(c_link(i)[j].e[k][l], cc, 1E-6);
+    #endif
+
+      if (!result)
+        return false;
+  }
+  return true;
+}
+
+template <class SiteArray, class MatrixArray>
+bool verify_mat_nn(const SiteArray &a, const MatrixArray &b, const SiteArray &c, size_t total_sites)
+{
+#ifdef USE_KOKKOS
+  return verify_links(a, b, [&](size_t i) { return c(i).link; }, total_sites);
+#else
+  return verify_links(a, b, [&](size_t i) { return c[i].link; }, total_sites);
+#endif
+}
+
+// Verification of C = op(A, B) for the mult_su3 family, with C zero before the
+// n calls of the accumulating forms
+template <class SiteArray, class MatrixArray>
+bool verify_mult(const SiteArray &a, const MatrixArray &b, const SiteArray &c, size_t total_sites,
+                 MultVariant v, size_t n)
+{
+  const Real scale = v == MULT_NN_ACC ? n : v == MULT_NN_AXPY ? n * AXPY_SCALE : 1;
+  // the accumulated sums carry the rounding of n additions, so the tolerance
+  // is relative to the result and grows with n in single precision
+  const double tol = std::max(1E-6, (double)std::numeric_limits<Real>::epsilon() * n) * std::max<Real>(1, scale);
+  for (size_t i=0;i<total_sites;++i) for(int j=0;j<4;++j) {
+  #ifdef USE_KOKKOS
+    const su3_matrix &aij = a(i).link[j], &cij = c(i).link[j];
+    const su3_matrix &bj = b(j);
+  #else
+    const su3_matrix &aij = a[i].link[j], &cij = c[i].link[j];
+    const su3_matrix &bj = b[j];
+  #endif
+    // written out here rather than through su3_ops.hpp, which the kernels use
+    for(int k=0;k<3;++k) for(int l=0;l<3;++l) {
+      Complx cc = {0.0, 0.0};
+      for(int m=0;m<3;++m) {
+        if (v == MULT_NA) {
+          CMUL_JSUM(aij.e[k][m], bj.e[l][m], cc);   // A * B^+
+        } else if (v == MULT_AN) {
+          CMUL_JSUM(bj.e[m][l], aij.e[m][k], cc);   // A^+ * B
+        } else {
+          CMULSUM(aij.e[k][m], bj.e[m][l], cc);
+        }
+      }
+      Complx e;
+      CMULREAL(cc, scale, e);
+    #ifdef MILC_COMPLEX
+      if (!almost_equal(cij.e[k][l].real, e.real, tol) || !almost_equal(cij.e[k][l].imag, e.imag, tol))
+    #else
+      if (!almost_equal(cij.e[k][l], e, tol))
+    #endif
+        return false;
+    }
+  }
+  return true;
+}
+
+// Verification of A = A*B applied n times in place, A_n = A_0 B^n for the
+// links a0 of A before the first call
+bool verify_inplace(const site *a, const site *a0, const su3_matrix *b, size_t total_sites, size_t n)
+{
+  su3_matrix bn[4], tmp;
+  for(int j=0;j<4;++j) for(int k=0;k<3;++k) for(int l=0;l<3;++l)
+    bn[j].e[k][l] = k == l ? Complx{1.0, 0.0} : Complx{0.0, 0.0};
+  for (size_t iters=0;iters<n;++iters)
+    for(int j=0;j<4;++j) {
+      ref_mult_nn(bn[j], b[j], tmp);
+      bn[j] = tmp;
+    }
+
+  // the rounding of the n products accumulates
+  const double tol = std::max(1E-6, 4 * (double)std::numeric_limits<Real>::epsilon() * n);
+  for (size_t i=0;i<total_sites;++i) for(int j=0;j<4;++j) {
+    su3_matrix expect;
+    ref_mult_nn(a0[i].link[j], bn[j], expect);
+    for(int k=0;k<3;++k) for(int l=0;l<3;++l)
+      if (!almost_equal((double)CREAL(a[i].link[j].e[k][l]), (double)CREAL(expect.e[k][l]), tol)
+      ||  !almost_equal((double)CIMAG(a[i].link[j].e[k][l]), (double)CIMAG(expect.e[k][l]), tol))
+        return false;
+  }
+  return true;
+}
+
+// Output storage, selected with -o
+//   site    - C is a full array of sites (default)
+//   inplace - A = A*B, no C lattice is allocated
+//   lean    - C is a bare link field without coordinates, parity or padding
+enum OutputMode { OUTPUT_SITE, OUTPUT_INPLACE, OUTPUT_LEAN };
+static const char *output_names[] = {"site", "inplace", "lean"};
+#if defined(USE_OPENMP_CPU) || defined(USE_KOKKOS)
+  #define OUTPUT_MODES
+  #define MULT_VARIANTS
+#endif
+
+// Benchmark modes, selected with -m
+#if defined(USE_KOKKOS) || defined(USE_SYCL) || defined(USE_DPCPP) || defined(USE_OPENMP_CPU)
+  #define LATENCY_MODE
+  #include "latency.hpp"
+#endif
+#ifdef USE_OPENMP_CPU
+  #define BATCH_MODE
+  #include "batch.hpp"
+  #define SWEEP_MODE
+  #include "sweep.hpp"
+  #define IMBALANCE_MODE
+  #include "imbalance.hpp"
+  #define MATVEC_MODE
+  #include "matvec_openmp2.hpp"
+  #define PLAQ_MODE
+  #include "plaq_openmp2.hpp"
+  #define SMEAR_MODE
+  #include "smear_openmp2.hpp"
+  #define HEATBATH_MODE
+  #include "heatbath_openmp2.hpp"
+  #define HMC_MODE
+  #include "hmc_openmp2.hpp"
+  #define TIMESLICE_MODE
+  #include "timeslice_openmp2.hpp"
+  #define GATHER_MODE
+  #include "gather_openmp2.hpp"
+  #define DIRTY_MODE
+  #include "dirty_openmp2.hpp"
+  #define TASKGRAPH_MODE
+  #include "taskgraph_openmp2.hpp"
+  #define MIX_MODE
+  #include "mix_openmp2.hpp"
+  #define JIT_MODE
+  #include "jit_openmp2.hpp"
+  #define CORUNNER_MODE
+  #include "corunner_openmp2.hpp"
+#endif
+
 // Main
 int main(int argc, char **argv)
 {
-  Profile profile;
+  Profile profile = {};
   size_t iterations = ITERATIONS;
   size_t ldim = LDIM;
+  size_t dims[4] = {0, 0, 0, 0};  // nx, ny, nz, nt when set with -L
   size_t threads_per_group = 128; // nominally works well across implementations
 #ifdef USE_DPCPP
   int device = 0;                 // DPCPP seg faults when device not provided
@@ -160,6 +374,28 @@ int main(int argc, char **argv)
 #endif
 
   std::string csv_filename = "";
+  std::string mode = "nn";
+  OutputMode output_mode = OUTPUT_SITE;
+#ifdef USE_OPENMP_CPU
+  // options of the OpenMP CPU modes
+  size_t batch = BATCH_SIZE;
+  std::string profile_filename = "";  // mix uses its built-in profile unless set
+  std::string corunner = "1";         // co-runner cores, stepping the intensity unless set
+  std::string schedule = "static";
+  int nrhs = 0;                   // matvec steps through 1..16 unless set
+  std::string smear = "ape";
+  int passes = 4;                 // smearing passes
+  bool reunit = false;            // reunitarize smeared links
+  double beta = 6.0;              // gauge coupling of the heatbath
+  int or_sweeps = 4;              // overrelaxation sweeps per heatbath sweep
+  std::string exp_spec = "cayley";
+  double step = 0.1;              // molecular dynamics step size
+  std::string strategy = "all";   // timeslice reduction strategies
+  std::string pattern = "all";    // gather patterns
+  size_t prefetch = 0;            // gather prefetch distance in sites
+  double dirty_fraction = 0.0;    // dirty steps through a range of fractions
+  size_t dirty_block = 0;         // and block sizes unless set, also the taskgraph block
+#endif
 
   int opt;
   g_argc = argc;
@@ -169,7 +405,7 @@ int main(int argc, char **argv)
   //   su3_mat_nn() implementations internally,
   //   as getopt rearrages the order of arguments and
   //   can screw things up for unknown options
-  while ((opt=getopt(argc, argv, ":hi:l:t:v:d:w:n:c:")) != -1) {
+  while ((opt=getopt(argc, argv, ":hi:l:L:t:v:d:w:n:c:p:y:m:u:C:o:B:T:s:r:k:S:N:Rb:O:x:e:g:P:D:f:z:F:H:")) != -1) {
     switch (opt) {
     case 'i':
       iterations = atoi(optarg);
@@ -177,6 +413,13 @@ int main(int argc, char **argv)
     case 'l':
       ldim = atoi(optarg);
       break;
+    case 'L':
+      if (sscanf(optarg, "%zu,%zu,%zu,%zu", &dims[0], &dims[1], &dims[2], &dims[3]) != 4
+      ||  dims[0] == 0 || dims[1] == 0 || dims[2] == 0 || dims[3] == 0) {
+        fprintf(stderr, "ERROR: Lattice dimensions must be given as nx,ny,nz,nt\n");
+        exit(1);
+      }
+      break;
     case 't':
       threads_per_group = atoi(optarg);
       break;
@@ -192,99 +435,314 @@ int main(int argc, char **argv)
     case 'c':
       csv_filename = optarg;
       break;
+    case 'm':
+      mode = optarg;
+      break;
+    case 'T':
+      trace_start(optarg);
+      break;
+#ifdef USE_OPENMP_CPU
+    case 'r':
+      nrhs = atoi(optarg);
+      break;
+    case 's':
+      schedule = optarg;
+      break;
+    case 'S':
+      smear = optarg;
+      break;
+    case 'N':
+      passes = atoi(optarg);
+      break;
+    case 'R':
+      reunit = true;
+      break;
+    case 'b':
+      beta = atof(optarg);
+      break;
+    case 'O':
+      or_sweeps = atoi(optarg);
+      break;
+    case 'x':
+      exp_spec = optarg;
+      break;
+    case 'e':
+      step = atof(optarg);
+      break;
+    case 'g':
+      strategy = optarg;
+      break;
+    case 'P':
+      pattern = optarg;
+      break;
+    case 'D':
+      prefetch = atoi(optarg);
+      break;
+    case 'f':
+      dirty_fraction = atof(optarg);
+      break;
+    case 'z':
+      dirty_block = atoi(optarg);
+      break;
+    case 'F':
+      profile_filename = optarg;
+      break;
+    case 'H':
+      corunner = optarg;
+      break;
+    case 'B':
+      batch = atoi(optarg);
+      break;
+#endif
+    case 'k':
+      for (int k = MULT_NN; k <= MULT_NN_AXPY; ++k)
+        if (std::string(optarg) == mult_names[k])
+          mult_variant = (MultVariant)k;
+      if (std::string(optarg) != mult_names[mult_variant]) {
+        fprintf(stderr, "ERROR: Unknown kernel %s (nn|na|an|nn_acc|nn_axpy)\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'o':
+      for (int o = OUTPUT_SITE; o <= OUTPUT_LEAN; ++o)
+        if (std::string(optarg) == output_names[o])
+          output_mode = (OutputMode)o;
+      if (std::string(optarg) != output_names[output_mode]) {
+        fprintf(stderr, "ERROR: Unknown output %s (site|inplace|lean)\n", optarg);
+        exit(1);
+      }
+      break;
     case 'h':
-      fprintf(stderr, "Usage: %s [-i iterations] [-l lattice dimension] \
-[-t threads per workgroup] [-d device] [-v verbosity level [0,1,2,3]] [-w warmups] [-c csv-file]\n", argv[0]);
+      fprintf(stderr, "Usage: %s [-i iterations] [-l lattice dimension] [-L nx,ny,nz,nt] \
+[-t threads per workgroup] [-d device] [-v verbosity level [0,1,2,3]] [-w warmups] [-c csv-file] \
+[-m mode [nn,latency,batch,sweep,imbalance,matvec,plaq,smear,heatbath,hmc,timeslice,gather,dirty,taskgraph,mix,jit,corunner]] [-o output [site,inplace,lean]] [-B batch size] [-T trace-file] [-s schedule[,chunk]] [-r nrhs] [-k kernel [nn,na,an,nn_acc,nn_axpy]] [-S ape|stout[,weight]] [-N passes] [-R] [-b beta] [-O overrelaxation sweeps] [-x cayley|taylor[,order]] [-e step] [-g time|space|twolevel|all] [-P pattern: gather contig|shift|stride|block|random|all, dirty contig|scattered|all, corunner stream|thrash|all] [-D prefetch distance] [-f dirty fraction] [-z block size: dirty, taskgraph] [-F profile file] [-H cores[,intensity]]\n", argv[0]);
       exit (EXIT_SUCCESS);
     }
   }
 
-  // allocate and initialize the working lattices and B su3 matrices
-  size_t total_sites = ldim*ldim*ldim*ldim;
 #ifdef USE_KOKKOS
   Kokkos::ScopeGuard scope(argc, argv);
   printf("Kokkos::ExecutionSpace = %s\n", typeid(ExecSpace).name());
+#endif
+
+  // -L overrides the hypercubic -l lattice
+  if (dims[0] == 0)
+    dims[0] = dims[1] = dims[2] = dims[3] = ldim;
+
+#ifndef MULT_VARIANTS
+  if (mult_variant != MULT_NN) {
+    fprintf(stderr, "ERROR: Kernel %s is not supported by this programming model\n", mult_names[mult_variant]);
+    exit(1);
+  }
+#endif
+  if (mult_variant != MULT_NN && mode != "nn") {
+    fprintf(stderr, "ERROR: Kernel %s is only supported in nn mode\n", mult_names[mult_variant]);
+    exit(1);
+  }
+
+  // modes other than the mult_su3_nn benchmark manage their own lattices
+#ifdef LATENCY_MODE
+  if (mode == "latency")
+    return run_latency(iterations, threads_per_group, device, csv_filename);
+#endif
+#ifdef BATCH_MODE
+  if (mode == "batch")
+    return run_batch(dims, batch, iterations);
+#endif
+#ifdef SWEEP_MODE
+  if (mode == "sweep")
+    return run_sweep(threads_per_group, device, csv_filename);
+#endif
+#ifdef IMBALANCE_MODE
+  if (mode == "imbalance")
+    return run_imbalance(dims, iterations, schedule);
+#endif
+#ifdef MATVEC_MODE
+  if (mode == "matvec")
+    return run_matvec(dims, iterations, nrhs);
+#endif
+#ifdef PLAQ_MODE
+  if (mode == "plaq")
+    return run_plaq(dims, iterations);
+#endif
+#ifdef SMEAR_MODE
+  if (mode == "smear")
+    return run_smear(dims, iterations, smear, passes, reunit);
+#endif
+#ifdef HEATBATH_MODE
+  if (mode == "heatbath")
+    return run_heatbath(dims, iterations, beta, or_sweeps);
+#endif
+#ifdef HMC_MODE
+  if (mode == "hmc")
+    return run_hmc(dims, iterations, exp_spec, step);
+#endif
+#ifdef TIMESLICE_MODE
+  if (mode == "timeslice")
+    return run_timeslice(dims, iterations, strategy);
+#endif
+#ifdef GATHER_MODE
+  if (mode == "gather")
+    return run_gather(dims, iterations, pattern, prefetch);
+#endif
+#ifdef DIRTY_MODE
+  if (mode == "dirty")
+    return run_dirty(dims, iterations, dirty_fraction, dirty_block, pattern, csv_filename);
+#endif
+#ifdef TASKGRAPH_MODE
+  if (mode == "taskgraph")
+    return run_taskgraph(dims, iterations, dirty_block);
+#endif
+#ifdef MIX_MODE
+  if (mode == "mix")
+    return run_mix(dims, iterations, profile_filename, csv_filename);
+#endif
+#ifdef JIT_MODE
+  if (mode == "jit")
+    return run_jit(dims, iterations, threads_per_group);
+#endif
+#ifdef CORUNNER_MODE
+  if (mode == "corunner")
+    return run_corunner(dims, iterations, corunner, pattern, csv_filename);
+#endif
+  if (mode != "nn") {
+    fprintf(stderr, "ERROR: Mode %s is not supported by this programming model\n", mode.c_str());
+    exit(1);
+  }
+  if (mult_variant != MULT_NN && output_mode != OUTPUT_SITE) {
+    fprintf(stderr, "ERROR: Kernel %s requires the site output\n", mult_names[mult_variant]);
+    exit(1);
+  }
+#ifndef OUTPUT_MODES
+  if (output_mode != OUTPUT_SITE) {
+    fprintf(stderr, "ERROR: Output %s is not supported by this programming model\n", output_names[output_mode]);
+    exit(1);
+  }
+#endif
+
+  // allocate and initialize the working lattices and B su3 matrices
+  // only the selected output storage is allocated
+  size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  const size_t c_sites = output_mode == OUTPUT_SITE ? total_sites : 0;
+  const size_t c_links = output_mode == OUTPUT_LEAN ? 4*total_sites : 0;
+  int64_t tphase = trace_now();
+#ifdef USE_KOKKOS
   h_site_view a("a", total_sites);
-  h_site_view c("c", total_sites);
+  h_site_view c("c", c_sites);
+  h_su3_matrix_view c_lean("c_lean", c_links);
   h_su3_matrix_view b("b", 4);
 #else
   std::vector<site> a(total_sites);
   std::vector<su3_matrix> b(4);
-  std::vector<site> c(total_sites);
+  std::vector<site> c(c_sites);
+  std::vector<su3_matrix> c_lean(c_links);
 #endif
+  trace_record("allocate", tphase);
 
 #ifdef USE_OPENMP_CPU
-  first_touch(a.data(), b.data(), c.data(), total_sites);
+  tphase = trace_now();
+  first_touch(a.data(), b.data(), c_sites > 0 ? c.data() : NULL, total_sites);
+  first_touch_links(c_lean.data(), c_links);
+  trace_record("first_touch", tphase);
 #endif
 
   // initialize the lattices
-  make_lattice(a.data(), ldim, Complx{1.0,0.0});
+  tphase = trace_now();
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
   init_link(b.data(), Complx{1.0/3.0,0.0});
+  // the in-place update and the mult_su3 variants need links that tell the
+  // operand order and adjoints apart, the in-place update is checked against
+  // a copy of the starting links
+  std::vector<site> a0;
+  if (output_mode == OUTPUT_INPLACE || mult_variant != MULT_NN)
+    make_check_links(a.data(), b.data(), total_sites);
+  if (output_mode == OUTPUT_INPLACE)
+    a0.assign(a.data(), a.data() + total_sites);
+  trace_record("make_lattice", tphase);
 
   if (verbose >= 1) {
-    printf("Number of sites = %zu^4\n", ldim);
+    if (dims[0] == dims[1] && dims[0] == dims[2] && dims[0] == dims[3])
+      printf("Number of sites = %zu^4\n", dims[0]);
+    else
+      printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
     printf("Executing %zu iterations with %zu warmups\n", iterations, warmups);
+    if (output_mode != OUTPUT_SITE)
+      printf("Output set to %s\n", output_names[output_mode]);
+    if (mult_variant != MULT_NN)
+      printf("Kernel set to mult_su3_%s\n", mult_names[mult_variant]);
   }
 
   // benchmark call
-  const double ttotal = su3_mat_nn(a, b, c, total_sites, iterations, threads_per_group, device, &profile);
+  double ttotal;
+  tphase = trace_now();
+#ifdef OUTPUT_MODES
+  if (output_mode == OUTPUT_INPLACE)
+    ttotal = su3_mat_nn_inplace(a, b, total_sites, iterations, threads_per_group, device, &profile);
+  else if (output_mode == OUTPUT_LEAN)
+    ttotal = su3_mat_nn(a, b, c_lean, total_sites, iterations, threads_per_group, device, &profile);
+  else
+#endif
+    ttotal = su3_mat_nn(a, b, c, total_sites, iterations, threads_per_group, device, &profile);
+  trace_record("su3_mat_nn", tphase);
   if (verbose >= 1) {
     printf("Total execution time = %f secs\n", ttotal);
-    printf("host_to_device_ms,kernel_ms,device_to_host_ms,num_iterations,num_warmups\n");
-    printf("%f,%f,%f,%lu,%lu\n",
+    printf("host_to_device_ms,kernel_ms,device_to_host_ms,num_iterations,num_warmups,build_ms,load_ms\n");
+    printf("%f,%f,%f,%lu,%lu,%f,%f\n",
            profile.host_to_device_time*1000,
            profile.kernel_time*1000,
            profile.device_to_host_time*1000,
            iterations,
-           warmups);
+           warmups,
+           profile.build_time*1000,
+           profile.load_time*1000);
   }
   if (csv_filename != "") {
     FILE* output = fopen(csv_filename.c_str(), "w");
-    fprintf(output, "host_to_device_ms,kernel_ms,device_to_host_ms,num_iterations,num_warmups\n");
-    fprintf(output, "%f,%f,%f,%lu,%lu\n",
+    fprintf(output, "host_to_device_ms,kernel_ms,device_to_host_ms,num_iterations,num_warmups,build_ms,load_ms\n");
+    fprintf(output, "%f,%f,%f,%lu,%lu,%f,%f\n",
             profile.host_to_device_time*1000,
             profile.kernel_time*1000,
             profile.device_to_host_time*1000,
             iterations,
-            warmups);
+            warmups,
+            profile.build_time*1000,
+            profile.load_time*1000);
     fclose(output);
   }
   // calculate flops/s, etc.
   // each matrix multiply is (3*3)*4*(12 mult + 12 add) = 4*(108 mult + 108 add) = 4*216 ops
-  const double tflop = (double)total_sites * 864.0;
+  // the accumulating forms add the sum, and the scaling for nn_axpy
+  const double tflop = (double)total_sites * mult_flops(mult_variant);
   printf("Total GFLOP/s = %.3f\n", iterations * tflop / ttotal / 1.0e9);
 
-  const double memory_usage = (double)sizeof(site) * (a.size() + c.size()) + sizeof(su3_matrix) * b.size();
-  printf("Total GByte/s (GPU memory)  = %.3f\n", iterations * memory_usage / ttotal / 1.0e9);
+  const double memory_usage = (double)sizeof(site) * (a.size() + c.size())
+                            + sizeof(su3_matrix) * (b.size() + c_lean.size());
+  // the in-place update and the accumulating forms also read their output
+  const bool reads_output = output_mode == OUTPUT_INPLACE || mult_variant == MULT_NN_ACC || mult_variant == MULT_NN_AXPY;
+  const double memory_traffic = memory_usage + (reads_output ? (double)sizeof(site) * a.size() : 0.0);
+  printf("Total GByte/s (GPU memory)  = %.3f\n", iterations * memory_traffic / ttotal / 1.0e9);
   fflush(stdout);
 
   // Verification of the result
-  bool result = true;
-  for (size_t i=0;i<total_sites;++i) for(int j=0;j<4;++j)  for(int k=0;k<3;++k)  for(int l=0;l<3;++l) {
-    Complx cc = {0.0, 0.0};
-    for(int m=0;m<3;m++) {
-      #ifdef MILC_COMPLEX
-        CMULSUM( a[i].link[j].e[k][m], b[j].e[m][l], cc)
-      #elif USE_KOKKOS
-        cc += a(i).link[j].e[k][m] * b[j].e[m][l];
-      #else
-        cc += a[i].link[j].e[k][m] * b[j].e[m][l];
-      #endif
-    }
-
-    #ifdef MILC_COMPLEX
-      result = almost_equal(c[i].link[j].e[k][l].real, cc.real, 1E-6);
-      result = almost_equal(c[i].link[j].e[k][l].imag, cc.imag, 1E-6);
-    #elif USE_KOKKOS
-      result = almost_equal(c(i).link[j].e[k][l], cc, 1E-6);
-    #else
-      result = almost_equal(c[i].link[j].e[k][l], cc, 1E-6);
-    #endif
-
-      if (!result) {
-        fprintf(stderr, "Verification Failed!\n");
-        return EXIT_FAILURE;
-      }
+  bool result;
+  tphase = trace_now();
+  if (output_mode == OUTPUT_INPLACE) {
+    result = verify_inplace(a.data(), a0.data(), b.data(), total_sites, iterations + warmups);
+  } else if (output_mode == OUTPUT_LEAN) {
+#ifdef USE_KOKKOS
+    result = verify_links(a, b, [&](size_t i) { return &c_lean(4*i); }, total_sites);
+#else
+    result = verify_links(a, b, [&](size_t i) { return &c_lean[4*i]; }, total_sites);
+#endif
+  } else if (mult_variant != MULT_NN) {
+    result = verify_mult(a, b, c, total_sites, mult_variant, iterations + warmups);
+  } else {
+    result = verify_mat_nn(a, b, c, total_sites);
+  }
+  trace_record("verify", tphase);
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
   }
 
   // check memory usage
@@ -0,0 +1,276 @@
+#ifndef _SU3_OPS_HPP
+#define _SU3_OPS_HPP
+// SU(3) matrix routines used by the kernel modes
+// Adapted from the libraries in MILC version 7, written with the complex
+// macros of su3.h/su3.hpp so they serve MILC and std/thrust/Kokkos complex
+
+#ifdef USE_KOKKOS
+  #define SU3_INLINE KOKKOS_INLINE_FUNCTION
+#else
+  #define SU3_INLINE inline
+#endif
+
+// Kernels of the mult_su3 family, selectable with -k
+//   nn      - C = A*B
+//   na      - C = A*adj(B)
+//   an      - C = adj(A)*B
+//   nn_acc  - C = C + A*B
+//   nn_axpy - C = C + s*A*B
+enum MultVariant { MULT_NN, MULT_NA, MULT_AN, MULT_NN_ACC, MULT_NN_AXPY };
+static const char *mult_names[] = {"nn", "na", "an", "nn_acc", "nn_axpy"};
+static MultVariant mult_variant = MULT_NN;
+
+#ifndef AXPY_SCALE
+#  define AXPY_SCALE 0.5
+#endif
+
+// flops per site, four links each of 3*3 entries
+//   a complex multiply-add is 8 flops, a complex add 2 and a real scaling 2
+static inline double mult_flops(MultVariant v)
+{
+  return 4*9*(3*8 + (v == MULT_NN_ACC ? 2 : v == MULT_NN_AXPY ? 4 : 0));
+}
+
+//*******************  m_mat_nn.c  (in su3.a) ****************************
+//  void mult_su3_nn( su3_matrix *a,*b,*c )
+//  matrix multiply, no adjoints
+//  C  <-  A*B
+SU3_INLINE void mult_su3_nn(const su3_matrix *a, const su3_matrix *b, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx x = {0.0, 0.0};
+      for (int k = 0; k < 3; k++)
+        CMULSUM(a->e[i][k], b->e[k][j], x);
+      c->e[i][j] = x;
+    }
+}
+
+//*******************  m_mat_na.c  (in su3.a) ****************************
+//  void mult_su3_na( su3_matrix *a,*b,*c )
+//  matrix multiply, second matrix is adjoint
+//  C  <-  A*B_adjoint
+SU3_INLINE void mult_su3_na(const su3_matrix *a, const su3_matrix *b, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx x = {0.0, 0.0};
+      for (int k = 0; k < 3; k++)
+        CMUL_JSUM(a->e[i][k], b->e[j][k], x);
+      c->e[i][j] = x;
+    }
+}
+
+//*******************  m_mat_an.c  (in su3.a) ****************************
+//  void mult_su3_an( su3_matrix *a,*b,*c )
+//  matrix multiply, first matrix is adjoint
+//  C  <-  A_adjoint*B
+SU3_INLINE void mult_su3_an(const su3_matrix *a, const su3_matrix *b, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx x = {0.0, 0.0};
+      for (int k = 0; k < 3; k++)
+        CMULJ_SUM(a->e[k][i], b->e[k][j], x);
+      c->e[i][j] = x;
+    }
+}
+
+//  C  <-  C + A*B
+SU3_INLINE void mult_su3_nn_sum(const su3_matrix *a, const su3_matrix *b, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx x = c->e[i][j];
+      for (int k = 0; k < 3; k++)
+        CMULSUM(a->e[i][k], b->e[k][j], x);
+      c->e[i][j] = x;
+    }
+}
+
+//  C  <-  C + s*A*B
+SU3_INLINE void scalar_mult_add_su3_nn(const su3_matrix *a, const su3_matrix *b, Real s, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx x = {0.0, 0.0}, y;
+      for (int k = 0; k < 3; k++)
+        CMULSUM(a->e[i][k], b->e[k][j], x);
+      CMULREAL(x, s, y);
+      CSUM(c->e[i][j], y);
+    }
+}
+
+// applies member V of the family to one link, V is resolved at compile time
+template <MultVariant V>
+SU3_INLINE void mult_su3(const su3_matrix *a, const su3_matrix *b, su3_matrix *c)
+{
+  if (V == MULT_NA)
+    mult_su3_na(a, b, c);
+  else if (V == MULT_AN)
+    mult_su3_an(a, b, c);
+  else if (V == MULT_NN_ACC)
+    mult_su3_nn_sum(a, b, c);
+  else if (V == MULT_NN_AXPY)
+    scalar_mult_add_su3_nn(a, b, AXPY_SCALE, c);
+  else
+    mult_su3_nn(a, b, c);
+}
+
+//*******************  su3_adjoint.c  (in su3.a) ***************************
+//  void su3_adjoint( su3_matrix *a, su3_matrix *b )
+//  B  <-  A_adjoint,  adjoint of an su3 matrix
+SU3_INLINE void su3_adjoint(const su3_matrix *a, su3_matrix *b)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      CONJG(a->e[j][i], b->e[i][j]);
+}
+
+//*******************  realtr.c  (in su3.a) *******************************
+//  Real realtrace_su3( su3_matrix *a,*b)
+//  return Re( Tr( A_adjoint*B )
+SU3_INLINE Real realtrace_su3(const su3_matrix *a, const su3_matrix *b)
+{
+  Real sum = 0.0;
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      sum += CREAL(a->e[i][j]) * CREAL(b->e[i][j]) + CIMAG(a->e[i][j]) * CIMAG(b->e[i][j]);
+  return sum;
+}
+
+//*******************  addmat.c  (in su3.a) *******************************
+//  void add_su3_matrix( su3_matrix *a, su3_matrix *b, su3_matrix *c )
+//  C  <-  A + B
+SU3_INLINE void add_su3_matrix(const su3_matrix *a, const su3_matrix *b, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      CADD(a->e[i][j], b->e[i][j], c->e[i][j]);
+}
+
+//*******************  s_m_a_mat.c  (in su3.a) ****************************
+//  void scalar_mult_add_su3_matrix( su3_matrix *a, su3_matrix *b,
+//	Real s, su3_matrix *c)
+//  C  <-  A + s*B
+SU3_INLINE void scalar_mult_add_su3_matrix(const su3_matrix *a, const su3_matrix *b, Real s, su3_matrix *c)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx y;
+      CMULREAL(b->e[i][j], s, y);
+      CADD(a->e[i][j], y, c->e[i][j]);
+    }
+}
+
+//*******************  s_m_mat.c  (in su3.a) ******************************
+//  void scalar_mult_su3_matrix( su3_matrix *a, Real s, su3_matrix *b )
+//  B  <-  s*A
+SU3_INLINE void scalar_mult_su3_matrix(const su3_matrix *a, Real s, su3_matrix *b)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      CMULREAL(a->e[i][j], s, b->e[i][j]);
+}
+
+//  B  <-  1, the identity
+SU3_INLINE void su3_identity(su3_matrix *b)
+{
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      b->e[i][j] = Complx{(Real)(i == j ? 1.0 : 0.0), 0.0};
+}
+
+//  B  <-  (A - A_adjoint)/2 - Tr(A - A_adjoint)/6
+//  the traceless anti-hermitian part of A
+SU3_INLINE void make_anti_hermitian(const su3_matrix *a, su3_matrix *b)
+{
+  Real tr = 0.0;
+  for (int i = 0; i < 3; i++)
+    tr += CIMAG(a->e[i][i]);
+  tr /= 3;
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      Complx y, z;
+      CONJG(a->e[j][i], y);
+      CSUB(a->e[i][j], y, z);
+      CMULREAL(z, (Real)0.5, b->e[i][j]);
+    }
+  for (int i = 0; i < 3; i++)
+    b->e[i][i] = Complx{0.0, CIMAG(b->e[i][i]) - tr};
+}
+
+#ifndef SU3_EXP_ORDER
+#  define SU3_EXP_ORDER 12  // default Taylor order of the exponential
+#endif
+
+//  B  <-  exp(A), the Taylor series to order n evaluated by Horner's rule
+//    exp(A) = 1 + A(1 + A/2(1 + A/3(... (1 + A/n))))
+SU3_INLINE void exp_su3_taylor(const su3_matrix *a, int n, su3_matrix *b)
+{
+  su3_matrix t;
+  su3_identity(b);
+  for (int k = n; k > 0; k--) {
+    mult_su3_nn(a, b, &t);
+    scalar_mult_su3_matrix(&t, (Real)1.0 / k, &t);
+    for (int i = 0; i < 3; i++)
+      t.e[i][i] = Complx{CREAL(t.e[i][i]) + 1, CIMAG(t.e[i][i])};
+    *b = t;
+  }
+}
+
+//*******************  reunitarize.c  (from generic) **********************
+//  void reunit_su3( su3_matrix *c )
+//  project C back onto SU(3) by Gram-Schmidt on the rows
+//  row 0 is normalized, row 1 is orthogonalized against it and normalized,
+//  and row 2 is the complex conjugate of their cross product
+SU3_INLINE void reunit_su3(su3_matrix *c)
+{
+  Real norm = 0.0;
+  for (int k = 0; k < 3; k++)
+    norm += CREAL(c->e[0][k]) * CREAL(c->e[0][k]) + CIMAG(c->e[0][k]) * CIMAG(c->e[0][k]);
+  norm = 1 / sqrt(norm);
+  for (int k = 0; k < 3; k++)
+    CMULREAL(c->e[0][k], norm, c->e[0][k]);
+
+  Complx dot = {0.0, 0.0};
+  for (int k = 0; k < 3; k++)
+    CMULJ_SUM(c->e[0][k], c->e[1][k], dot);
+  for (int k = 0; k < 3; k++) {
+    Complx y;
+    CMUL(dot, c->e[0][k], y);
+    CSUB(c->e[1][k], y, c->e[1][k]);
+  }
+  norm = 0.0;
+  for (int k = 0; k < 3; k++)
+    norm += CREAL(c->e[1][k]) * CREAL(c->e[1][k]) + CIMAG(c->e[1][k]) * CIMAG(c->e[1][k]);
+  norm = 1 / sqrt(norm);
+  for (int k = 0; k < 3; k++)
+    CMULREAL(c->e[1][k], norm, c->e[1][k]);
+
+  for (int k = 0; k < 3; k++) {
+    const int i = (k + 1) % 3, j = (k + 2) % 3;
+    Complx x, y, z;
+    CMUL(c->e[0][i], c->e[1][j], x);
+    CMUL(c->e[0][j], c->e[1][i], y);
+    CSUB(x, y, z);
+    CONJG(z, c->e[2][k]);
+  }
+}
+
+//  returns max | (A_adjoint*A - 1)_ij |, the distance of A from unitarity
+SU3_INLINE double unitarity_deviation(const su3_matrix *a)
+{
+  su3_matrix t;
+  mult_su3_an(a, a, &t);
+  double dev = 0.0;
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      const double re = CREAL(t.e[i][j]) - (i == j ? 1.0 : 0.0), im = CIMAG(t.e[i][j]);
+      const double d = sqrt(re * re + im * im);
+      dev = d > dev ? d : dev;
+    }
+  return dev;
+}
+
+#endif  // _SU3_OPS_HPP
@@ -0,0 +1,158 @@
+#ifndef _SWEEP_HPP
+#define _SWEEP_HPP
+// Working set sweep mode
+// Steps the working set of su3_mat_nn() from L1 resident to several times the
+// last level cache, in SWEEP_STEPS geometric steps per doubling.  A single pair
+// of lattices sized for the largest point is allocated, and each point runs on
+// its leading sites.  The iteration count of each point is calibrated so that
+// its timed loop takes about SWEEP_TIME seconds.
+// Each point keeps the best of SWEEP_REPEAT timed loops.  A knee is reported
+// where the mean bandwidth over the next doubling of the working set falls more
+// than SWEEP_KNEE below the mean over the previous doubling, next to the cache
+// sizes the system reports.
+#include <algorithm>
+
+#ifndef SWEEP_MIN_SITES
+#  define SWEEP_MIN_SITES 4
+#endif
+#ifndef SWEEP_STEPS
+#  define SWEEP_STEPS 4        // points per doubling of the working set
+#endif
+#ifndef SWEEP_LLC_FACTOR
+#  define SWEEP_LLC_FACTOR 4   // largest working set in multiples of the LLC
+#endif
+#ifndef SWEEP_TIME
+#  define SWEEP_TIME 0.1       // seconds per point
+#endif
+#ifndef SWEEP_REPEAT
+#  define SWEEP_REPEAT 3
+#endif
+#ifndef SWEEP_KNEE
+#  define SWEEP_KNEE 0.2       // relative bandwidth drop marking a knee
+#endif
+
+// data cache sizes of the system, 0 when unknown
+static void cache_sizes(long size[3])
+{
+  size[0] = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+  size[1] = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  size[2] = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  for (int i = 0; i < 3; ++i)
+    if (size[i] < 0)
+      size[i] = 0;
+}
+
+int run_sweep(size_t threads_per_group, int device, const std::string &csv_filename)
+{
+  long cache[3];
+  cache_sizes(cache);
+  const long llc = std::max(std::max(cache[0], cache[1]), cache[2]) > 0
+                 ? std::max(std::max(cache[0], cache[1]), cache[2]) : 64L*1024*1024;
+
+  // bytes moved per site and per call, A and C plus the four B matrices
+  const double site_bytes = 2.0 * sizeof(site);
+  const double fixed_bytes = 4.0 * sizeof(su3_matrix);
+  const size_t max_sites = (size_t)(SWEEP_LLC_FACTOR * (double)llc / site_bytes);
+
+  // geometric steps in the number of sites
+  std::vector<size_t> points;
+  for (double s = SWEEP_MIN_SITES; s <= max_sites; s *= std::pow(2.0, 1.0/SWEEP_STEPS))
+    if (points.empty() || (size_t)s != points.back())
+      points.push_back((size_t)s);
+
+  std::vector<site> a(max_sites);
+  std::vector<su3_matrix> b(4);
+  std::vector<site> c(max_sites);
+  first_touch(a.data(), b.data(), c.data(), max_sites);
+  make_lattice(a.data(), max_sites, 1, 1, 1, Complx{1.0,0.0});
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+
+  if (verbose >= 1)
+    printf("Working set sweep from %.1f KiB to %.1f MiB in %zu points\n",
+           (site_bytes * points.front() + fixed_bytes) / 1024.0,
+           (site_bytes * points.back() + fixed_bytes) / 1024.0 / 1024.0, points.size());
+
+  const unsigned int saved_verbose = verbose;
+  bool result = true;
+  const size_t n = points.size();
+  std::vector<size_t> iterations(n);
+  std::vector<double> ttotal(n), gbytes(n);
+  for (size_t p = 0; p < n; ++p) {
+    const size_t total_sites = points[p];
+    Profile profile;
+    verbose = 0;
+
+    // calibrate the iteration count, doubling until the loop is long enough to scale
+    size_t iters = 1;
+    double t = su3_mat_nn(a, b, c, total_sites, iters, threads_per_group, device, &profile);
+    while (t < SWEEP_TIME / 10) {
+      iters *= 2;
+      t = su3_mat_nn(a, b, c, total_sites, iters, threads_per_group, device, &profile);
+    }
+    iterations[p] = std::max<size_t>(1, (size_t)(iters * SWEEP_TIME / t));
+    ttotal[p] = 1.0e30;
+    for (int r = 0; r < SWEEP_REPEAT; ++r)
+      ttotal[p] = std::min(ttotal[p], su3_mat_nn(a, b, c, total_sites, iterations[p], threads_per_group, device, &profile));
+    verbose = saved_verbose;
+    result = result && verify_mat_nn(a, b, c, total_sites);
+    gbytes[p] = iterations[p] * (site_bytes * total_sites + fixed_bytes) / ttotal[p] / 1.0e9;
+  }
+
+  // knees, comparing the mean bandwidth of one doubling on either side of each
+  // point, keeping the steepest point of each run of consecutive drops
+  const size_t w = SWEEP_STEPS;
+  std::vector<int> knee(n, 0);
+  double steepest = 0.0;
+  size_t run = 0;
+  for (size_t p = w; p + w <= n; ++p) {
+    double before = 0.0, after = 0.0;
+    for (size_t q = 0; q < w; ++q) {
+      before += gbytes[p-w+q];
+      after += gbytes[p+q];
+    }
+    const double drop = 1.0 - after / before;
+    if (drop > SWEEP_KNEE) {
+      if (drop > steepest) {
+        if (steepest > 0.0)
+          knee[run] = 0;
+        knee[p] = 1;
+        steepest = drop;
+        run = p;
+      }
+    } else {
+      steepest = 0.0;
+    }
+  }
+
+  FILE *output = NULL;
+  if (csv_filename != "") {
+    output = fopen(csv_filename.c_str(), "w");
+    fprintf(output, "footprint_bytes,sites,iterations,time_s,gbyte_s,gflop_s,knee\n");
+  }
+  if (verbose >= 1)
+    printf("%14s %10s %10s %12s %12s %5s\n", "footprint_KiB", "sites", "iterations", "GByte/s", "GFLOP/s", "knee");
+  for (size_t p = 0; p < n; ++p) {
+    const double footprint = site_bytes * points[p] + fixed_bytes;
+    const double gflops = iterations[p] * 864.0 * points[p] / ttotal[p] / 1.0e9;
+    if (verbose >= 1)
+      printf("%14.1f %10zu %10zu %12.3f %12.3f %5s\n", footprint / 1024.0, points[p], iterations[p],
+             gbytes[p], gflops, knee[p] ? "*" : "");
+    if (output != NULL)
+      fprintf(output, "%.0f,%zu,%zu,%f,%f,%f,%d\n", footprint, points[p], iterations[p], ttotal[p], gbytes[p], gflops, knee[p]);
+  }
+  if (output != NULL)
+    fclose(output);
+
+  printf("Reported caches: L1d %ld KiB, L2 %ld KiB, L3 %ld KiB\n", cache[0]/1024, cache[1]/1024, cache[2]/1024);
+  for (size_t p = 0; p < n; ++p)
+    if (knee[p])
+      printf("Knee detected at a footprint of %.1f KiB\n", (site_bytes * points[p] + fixed_bytes) / 1024.0);
+
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _SWEEP_HPP
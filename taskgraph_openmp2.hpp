@@ -0,0 +1,250 @@
+#ifndef _TASKGRAPH_OPENMP2_HPP
+#define _TASKGRAPH_OPENMP2_HPP
+// Task graph mode
+// A pipeline of four kernels per iteration, run on blocks of -z sites,
+//   K1  C = s*A*B                   products in the link directions
+//   K2  D = s*A*adj(B)              products in the reverse directions
+//   K3  E = C + D                   conversion to a bare link field
+//   K4  partial[blk] = Re Tr E      reduction, combined by a pairwise tree
+// with s = iteration + 1, so that a kernel reading a block of the previous
+// iteration through a missing dependence changes the sums.
+// It is run twice.  The barrier version runs each kernel as an OpenMP loop over
+// all sites, closed by the implicit barrier, as in mat_nn_openmp2.hpp.  The task
+// version creates one task per kernel and block, with dependences on the blocks
+// of C, D and E only.  Kernels and blocks then overlap freely, also across
+// iterations, and a block of C and D is consumed while still in cache.  The
+// tasks are scheduled by the OpenMP runtime, whose idle threads take queued
+// tasks from the others (work stealing in the LLVM runtime).  Where the kernel
+// allows it, last level cache misses are counted with perf_event_open.
+//   -z block size
+#include <cstring>
+#include <omp.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "reduce_openmp2.hpp"
+
+#ifndef TASK_BLOCK
+#  define TASK_BLOCK 256  // sites
+#endif
+
+// last level cache misses of the OpenMP threads, one counter per thread
+struct CacheCounter {
+  std::vector<int> fd;
+  bool available = true;
+  CacheCounter() : fd(omp_get_max_threads(), -1) {
+    #pragma omp parallel
+    {
+      struct perf_event_attr pe;
+      memset(&pe, 0, sizeof(pe));
+      pe.type = PERF_TYPE_HARDWARE;
+      pe.size = sizeof(pe);
+      pe.config = PERF_COUNT_HW_CACHE_MISSES;
+      pe.disabled = 1;
+      pe.exclude_kernel = 1;
+      pe.exclude_hv = 1;
+      fd[omp_get_thread_num()] = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+    }
+    for (int f : fd)
+      available = available && f >= 0;
+  }
+  ~CacheCounter() {
+    for (int f : fd)
+      if (f >= 0)
+        close(f);
+  }
+  void start() {
+    for (int f : fd)
+      if (f >= 0) {
+        ioctl(f, PERF_EVENT_IOC_RESET, 0);
+        ioctl(f, PERF_EVENT_IOC_ENABLE, 0);
+      }
+  }
+  // the misses since start(), summed over the threads
+  double stop() {
+    uint64_t total = 0;
+    for (int f : fd)
+      if (f >= 0) {
+        uint64_t count = 0;
+        ioctl(f, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(f, &count, sizeof(count)) == sizeof(count))
+          total += count;
+      }
+    return (double)total;
+  }
+};
+
+struct Pipeline {
+  const site *a;
+  const su3_matrix *b;
+  site *c, *d;
+  su3_matrix *e;
+  double *partial;  // per iteration and block
+  size_t total_sites, block, blocks;
+};
+
+static inline void k1_block(const Pipeline &p, size_t blk, Real scale)
+{
+  for (size_t i = blk * p.block; i < std::min(p.total_sites, (blk + 1) * p.block); ++i) {
+    mult_su3_site(&p.a[i], p.b, p.c[i].link);
+    for (int mu = 0; mu < 4; ++mu)
+      scalar_mult_su3_matrix(&p.c[i].link[mu], scale, &p.c[i].link[mu]);
+  }
+}
+
+static inline void k2_block(const Pipeline &p, size_t blk, Real scale)
+{
+  for (size_t i = blk * p.block; i < std::min(p.total_sites, (blk + 1) * p.block); ++i)
+    for (int mu = 0; mu < 4; ++mu) {
+      mult_su3_na(&p.a[i].link[mu], &p.b[mu], &p.d[i].link[mu]);
+      scalar_mult_su3_matrix(&p.d[i].link[mu], scale, &p.d[i].link[mu]);
+    }
+}
+
+static inline void k3_block(const Pipeline &p, size_t blk)
+{
+  for (size_t i = blk * p.block; i < std::min(p.total_sites, (blk + 1) * p.block); ++i)
+    for (int mu = 0; mu < 4; ++mu)
+      add_su3_matrix(&p.c[i].link[mu], &p.d[i].link[mu], &p.e[4*i + mu]);
+}
+
+static inline void k4_block(const Pipeline &p, size_t blk, double *partial)
+{
+  double sum = 0.0;
+  for (size_t i = blk * p.block; i < std::min(p.total_sites, (blk + 1) * p.block); ++i)
+    for (int mu = 0; mu < 4; ++mu)
+      for (int k = 0; k < 3; ++k)
+        sum += CREAL(p.e[4*i + mu].e[k][k]);
+  partial[blk] = sum;
+}
+
+// each kernel a parallel loop closed by a barrier
+static void run_barriers(const Pipeline &p, size_t iterations)
+{
+  for (size_t iters = 0; iters < iterations; ++iters) {
+    double *partial = p.partial + iters * p.blocks;
+    const Real scale = iters + 1;
+    #pragma omp parallel for schedule(static)
+    for (size_t blk = 0; blk < p.blocks; ++blk)
+      k1_block(p, blk, scale);
+    #pragma omp parallel for schedule(static)
+    for (size_t blk = 0; blk < p.blocks; ++blk)
+      k2_block(p, blk, scale);
+    #pragma omp parallel for schedule(static)
+    for (size_t blk = 0; blk < p.blocks; ++blk)
+      k3_block(p, blk);
+    #pragma omp parallel for schedule(static)
+    for (size_t blk = 0; blk < p.blocks; ++blk)
+      k4_block(p, blk, partial);
+  }
+}
+
+// one task per kernel and block, ordered only by the block dependences
+static void run_tasks(const Pipeline &p, size_t iterations)
+{
+  // a block of C, D or E is stood for by its first site in the dependences
+  #pragma omp parallel
+  #pragma omp single
+  for (size_t iters = 0; iters < iterations; ++iters) {
+    double *partial = p.partial + iters * p.blocks;
+    const Real scale = iters + 1;
+    for (size_t blk = 0; blk < p.blocks; ++blk) {
+      #pragma omp task firstprivate(blk, scale) depend(out: p.c[blk * p.block])
+      k1_block(p, blk, scale);
+      #pragma omp task firstprivate(blk, scale) depend(out: p.d[blk * p.block])
+      k2_block(p, blk, scale);
+      #pragma omp task firstprivate(blk) depend(in: p.c[blk * p.block], p.d[blk * p.block]) \
+                       depend(out: p.e[4 * blk * p.block])
+      k3_block(p, blk);
+      #pragma omp task firstprivate(blk, partial) depend(in: p.e[4 * blk * p.block])
+      k4_block(p, blk, partial);
+    }
+  }
+}
+
+int run_taskgraph(const size_t dims[4], size_t iterations, size_t block)
+{
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Task graph mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+  const size_t total_sites = dims[0]*dims[1]*dims[2]*dims[3];
+  if (block == 0)
+    block = TASK_BLOCK;
+  const size_t blocks = (total_sites + block - 1) / block;
+  std::vector<site> a(total_sites), c(total_sites), d(total_sites);
+  std::vector<su3_matrix> b(4), e(4 * total_sites);
+  first_touch(a.data(), b.data(), c.data(), total_sites);
+  first_touch(d.data(), b.data(), NULL, total_sites);
+  first_touch_links(e.data(), 4 * total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+  std::vector<double> partial((iterations + warmups) * blocks);
+  Pipeline p = {a.data(), b.data(), c.data(), d.data(), e.data(), partial.data(), total_sites, block, blocks};
+
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, omp_get_max_threads());
+    printf("%zu blocks of %zu sites, %zu tasks per iteration\n", blocks, block, 4 * blocks);
+  }
+
+  // the flops of the two scaled products, the addition and the trace, and the
+  // traffic when every kernel streams its operands from memory
+  const double flops = (2 * (864.0 + 4*18) + 4*18 + 4*3) * total_sites;
+  const double bytes = (4.0 * sizeof(site) + 4 * sizeof(su3_matrix)) * total_sites  // K1, K2
+                     + (2.0 * sizeof(site) + 4 * sizeof(su3_matrix)) * total_sites  // K3
+                     + 4.0 * sizeof(su3_matrix) * total_sites;                      // K4
+  CacheCounter counter;
+  printf("%10s %12s %12s %12s %14s\n", "schedule", "ms_per_iter", "GFLOP/s", "GByte/s", "LLC_miss/site");
+
+  std::vector<double> sums[2];
+  double time[2];
+  for (int tasks = 0; tasks < 2; ++tasks) {
+    if (warmups > 0) {
+      TRACE_ZONE("warmup");
+      Pipeline w = p;
+      w.partial = partial.data() + iterations * blocks;
+      tasks ? run_tasks(w, warmups) : run_barriers(w, warmups);
+    }
+    double misses;
+    {
+      TRACE_ZONE(tasks ? "tasks" : "barriers");
+      counter.start();
+      auto tstart = Clock::now();
+      tasks ? run_tasks(p, iterations) : run_barriers(p, iterations);
+      time[tasks] = std::chrono::duration<double>(Clock::now()-tstart).count();
+      misses = counter.stop();
+    }
+    for (size_t iters = 0; iters < iterations; ++iters)
+      sums[tasks].push_back(tree_sum(partial.data() + iters * blocks, blocks));
+    printf("%10s %12.3f %12.3f %12.3f ", tasks ? "tasks" : "barriers", time[tasks] / iterations * 1.0e3,
+           iterations * flops / time[tasks] / 1.0e9, iterations * bytes / time[tasks] / 1.0e9);
+    if (counter.available)
+      printf("%14.3f\n", misses / iterations / total_sites);
+    else
+      printf("%14s\n", "unavailable");
+  }
+  printf("Task graph speedup over barriers = %.3f\n", time[0] / time[1]);
+
+  // both schedules sum the same block partials in the same order
+  bool result = memcmp(sums[0].data(), sums[1].data(), iterations * sizeof(double)) == 0;
+  if (!result)
+    fprintf(stderr, "Task graph and barrier results differ\n");
+#ifndef RANDOM_INIT
+  // A*B and A*adj(B) are all ones, so each link of E has the trace 6 s
+  for (size_t iters = 0; iters < iterations; ++iters)
+    if (!almost_equal(sums[1][iters] / (24.0 * total_sites * (iters + 1)), 1.0, 1E-6)) {
+      fprintf(stderr, "Sum %.17g of iteration %zu differs from the expected %zu\n",
+              sums[1][iters], iters, 24 * total_sites * (iters + 1));
+      result = false;
+      break;
+    }
+#endif
+  if (!result) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _TASKGRAPH_OPENMP2_HPP
@@ -0,0 +1,181 @@
+#ifndef _TIMESLICE_OPENMP2_HPP
+#define _TIMESLICE_OPENMP2_HPP
+// Timeslice reduction mode
+// Computes the correlator-like sum over the spatial volume of every timeslice,
+//   C(t) = sum_xyz sum_mu Re Tr( A_mu(x,y,z,t) B_mu )
+// the trace of the mult_su3_nn product without storing it.  The sites of a
+// timeslice are contiguous, so the sum is a segmented reduction over nt
+// segments of nx*ny*nz sites.  The strategies, selected with -g, are
+//   time      parallel over t, each timeslice summed in site order by one thread
+//   space     parallel over the sites, each of TIMESLICE_PARTIALS fixed chunks
+//             accumulating its own array of nt partials, combined in chunk order
+//   twolevel  parallel over the blocks of REDUCE_BLOCK sites of every timeslice,
+//             combined per timeslice by the pairwise tree of reduce_openmp2.hpp
+// The chunks of space stand in for per-thread arrays; being fixed in number
+// they keep the result independent of the thread count, which the mode checks
+// by repeating every strategy on one thread.
+//   -g time|space|twolevel|all
+#include <cstring>
+#include <omp.h>
+#include "reduce_openmp2.hpp"
+
+#ifndef TIMESLICE_PARTIALS
+#  define TIMESLICE_PARTIALS 64  // partial arrays of the space strategy
+#endif
+
+enum TimesliceStrategy { TIMESLICE_TIME, TIMESLICE_SPACE, TIMESLICE_TWOLEVEL };
+static const char *timeslice_names[] = {"time", "space", "twolevel"};
+
+// sum_mu Re Tr(A_mu B_mu) at site i
+static inline double site_trace(const site *a, const su3_matrix *b, size_t i)
+{
+  double sum = 0.0;
+  for (int mu = 0; mu < 4; ++mu)
+    for (int k = 0; k < 3; ++k)
+      for (int l = 0; l < 3; ++l)
+        sum += CREAL(a[i].link[mu].e[k][l]) * CREAL(b[mu].e[l][k])
+             - CIMAG(a[i].link[mu].e[k][l]) * CIMAG(b[mu].e[l][k]);
+  return sum;
+}
+
+// corr[t] for every timeslice, partial is scratch sized by timeslice_scratch()
+static void timeslice_sum(TimesliceStrategy strategy, const site *a, const su3_matrix *b,
+                          size_t nt, size_t vs, double *partial, double *corr)
+{
+  if (strategy == TIMESLICE_TIME) {
+    #pragma omp parallel for schedule(static)
+    for (size_t t = 0; t < nt; ++t) {
+      double sum = 0.0;
+      for (size_t i = t * vs; i < (t + 1) * vs; ++i)
+        sum += site_trace(a, b, i);
+      corr[t] = sum;
+    }
+  } else if (strategy == TIMESLICE_SPACE) {
+    const size_t total_sites = nt * vs;
+    const size_t chunk = (total_sites + TIMESLICE_PARTIALS - 1) / TIMESLICE_PARTIALS;
+    #pragma omp parallel for schedule(static)
+    for (size_t p = 0; p < TIMESLICE_PARTIALS; ++p) {
+      double *mine = partial + p * nt;
+      for (size_t t = 0; t < nt; ++t)
+        mine[t] = 0.0;
+      const size_t end = std::min(total_sites, (p + 1) * chunk);
+      for (size_t i = p * chunk; i < end; ++i)
+        mine[i / vs] += site_trace(a, b, i);
+    }
+    #pragma omp parallel for schedule(static)
+    for (size_t t = 0; t < nt; ++t) {
+      double sum = 0.0;
+      for (size_t p = 0; p < TIMESLICE_PARTIALS; ++p)
+        sum += partial[p * nt + t];
+      corr[t] = sum;
+    }
+  } else {
+    const size_t blocks = reduce_blocks(vs);
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (size_t t = 0; t < nt; ++t)
+      for (size_t blk = 0; blk < blocks; ++blk) {
+        double sum = 0.0;
+        const size_t end = t * vs + std::min(vs, (blk + 1) * REDUCE_BLOCK);
+        for (size_t i = t * vs + blk * REDUCE_BLOCK; i < end; ++i)
+          sum += site_trace(a, b, i);
+        partial[t * blocks + blk] = sum;
+      }
+    #pragma omp parallel for schedule(static)
+    for (size_t t = 0; t < nt; ++t)
+      corr[t] = tree_sum(partial + t * blocks, blocks);
+  }
+}
+
+static size_t timeslice_scratch(size_t nt, size_t vs)
+{
+  return std::max((size_t)TIMESLICE_PARTIALS * nt, nt * reduce_blocks(vs));
+}
+
+int run_timeslice(const size_t dims[4], size_t iterations, const std::string &strategy)
+{
+  std::vector<TimesliceStrategy> strategies;
+  for (int g = TIMESLICE_TIME; g <= TIMESLICE_TWOLEVEL; ++g)
+    if (strategy == "all" || strategy == timeslice_names[g])
+      strategies.push_back((TimesliceStrategy)g);
+  if (strategies.empty()) {
+    fprintf(stderr, "ERROR: Unknown strategy %s (time|space|twolevel|all)\n", strategy.c_str());
+    return EXIT_FAILURE;
+  }
+  if (iterations == 0) {
+    fprintf(stderr, "ERROR: Timeslice mode requires at least one iteration\n");
+    return EXIT_FAILURE;
+  }
+
+  const size_t nt = dims[3], vs = dims[0]*dims[1]*dims[2];
+  const size_t total_sites = nt * vs;
+  std::vector<site> a(total_sites);
+  std::vector<su3_matrix> b(4);
+  first_touch(a.data(), b.data(), NULL, total_sites);
+  make_lattice(a.data(), dims[0], dims[1], dims[2], dims[3], Complx{1.0,0.0});
+  init_link(b.data(), Complx{1.0/3.0,0.0});
+  std::vector<double> partial(timeslice_scratch(nt, vs));
+  std::vector<double> corr(nt), corr1(nt), first(nt);
+
+  const int threads = omp_get_max_threads();
+  if (verbose >= 1) {
+    printf("Number of sites = %zux%zux%zux%zu\n", dims[0], dims[1], dims[2], dims[3]);
+    printf("Executing %zu iterations with %zu warmups on %d threads\n", iterations, warmups, threads);
+    printf("%10s %14s %12s %12s\n", "strategy", "us_per_iter", "GByte/s", "parallelism");
+  }
+
+  bool ok = true;
+  for (TimesliceStrategy g : strategies) {
+    auto tstart = Clock::now();
+    for (size_t iters = 0; iters < iterations + warmups; ++iters) {
+      if (iters == warmups)
+        tstart = Clock::now();
+      TRACE_ZONE(iters < warmups ? "warmup" : "iteration");
+      timeslice_sum(g, a.data(), b.data(), nt, vs, partial.data(), corr.data());
+    }
+    const double ttotal = std::chrono::duration<double>(Clock::now()-tstart).count();
+
+    // the units of work the strategy has to spread over the threads
+    const size_t work = g == TIMESLICE_TIME ? nt : g == TIMESLICE_SPACE ? TIMESLICE_PARTIALS
+                      : nt * reduce_blocks(vs);
+    printf("%10s %14.3f %12.3f %12zu\n", timeslice_names[g], ttotal / iterations * 1.0e6,
+           iterations * (double)sizeof(site) * total_sites / ttotal / 1.0e9, work);
+
+    // the same strategy on one thread must agree in every bit
+    omp_set_num_threads(1);
+    timeslice_sum(g, a.data(), b.data(), nt, vs, partial.data(), corr1.data());
+    omp_set_num_threads(threads);
+    if (memcmp(corr.data(), corr1.data(), nt * sizeof(double)) != 0) {
+      fprintf(stderr, "Strategy %s differs between %d threads and 1 thread\n", timeslice_names[g], threads);
+      ok = false;
+    }
+    // and the strategies agree up to rounding
+    if (g == strategies[0])
+      first = corr;
+    for (size_t t = 0; t < nt; ++t)
+      if (!almost_equal(corr[t], first[t], 1E-10 * vs)) {
+        fprintf(stderr, "Strategy %s differs at t = %zu\n", timeslice_names[g], t);
+        ok = false;
+        break;
+      }
+  }
+
+  if (verbose >= 2)
+    for (size_t t = 0; t < nt; ++t)
+      printf("C(%zu) = %.17g\n", t, corr[t]);
+#ifndef RANDOM_INIT
+  // with every element of A 1 and of B 1/3, each of the four traces is 3
+  for (size_t t = 0; t < nt; ++t)
+    if (!almost_equal(corr[t] / (12.0 * vs), 1.0, 1E-6)) {
+      fprintf(stderr, "C(%zu) = %.17g differs from the expected %zu\n", t, corr[t], 12 * vs);
+      ok = false;
+      break;
+    }
+#endif
+  if (!ok) {
+    fprintf(stderr, "Verification Failed!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif  // _TIMESLICE_OPENMP2_HPP
@@ -0,0 +1,119 @@
+#ifndef _TRACE_HPP
+#define _TRACE_HPP
+// Timeline tracing
+// Scoped zones are recorded into per-thread ring buffers and written as Chrome
+// trace JSON at exit, for viewing in chrome://tracing or ui.perfetto.dev.
+// Tracing is enabled at runtime with -T file; when disabled a zone costs a
+// single test of trace_enabled.
+//   TRACE_ZONE("name")      - records the enclosing scope
+//   trace_record("name", t) - records from t = trace_now() to now
+// Each buffer keeps the last TRACE_BUFFER_EVENTS events of its thread.
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef TRACE_BUFFER_EVENTS
+#  define TRACE_BUFFER_EVENTS 65536
+#endif
+
+typedef std::chrono::steady_clock TraceClock;
+
+struct TraceEvent {
+  const char *name;
+  int64_t begin, end;  // ns since the start of tracing
+};
+
+struct TraceBuffer {
+  int tid;
+  size_t count = 0;  // total events recorded, the buffer holds the last TRACE_BUFFER_EVENTS
+  std::vector<TraceEvent> events;
+  TraceBuffer(int id) : tid(id), events(TRACE_BUFFER_EVENTS) {}
+};
+
+static bool trace_enabled = false;
+static std::string trace_filename;
+static TraceClock::time_point trace_origin;
+static std::mutex trace_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+
+static inline int64_t trace_now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(TraceClock::now() - trace_origin).count();
+}
+
+// the calling thread's buffer, registered on first use
+static TraceBuffer *trace_buffer()
+{
+  static thread_local TraceBuffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_buffers.emplace_back(new TraceBuffer((int)trace_buffers.size()));
+    buffer = trace_buffers.back().get();
+  }
+  return buffer;
+}
+
+static inline void trace_record(const char *name, int64_t begin)
+{
+  if (!trace_enabled)
+    return;
+  TraceBuffer *buffer = trace_buffer();
+  buffer->events[buffer->count++ % TRACE_BUFFER_EVENTS] = TraceEvent{name, begin, trace_now()};
+}
+
+struct TraceZone {
+  const char *name;
+  int64_t begin;
+  TraceZone(const char *n) : name(n), begin(trace_enabled ? trace_now() : 0) {}
+  ~TraceZone() { trace_record(name, begin); }
+};
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+// writes the buffers as complete ("X") events, timestamps in microseconds
+static void trace_write()
+{
+  FILE *output = fopen(trace_filename.c_str(), "w");
+  if (output == NULL) {
+    fprintf(stderr, "ERROR: Unable to write trace file %s\n", trace_filename.c_str());
+    return;
+  }
+  size_t dropped = 0;
+  const char *sep = "";
+  fprintf(output, "{\"traceEvents\":[\n");
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  for (auto &buffer : trace_buffers) {
+    const size_t n = std::min<size_t>(buffer->count, TRACE_BUFFER_EVENTS);
+    dropped += buffer->count - n;
+    fprintf(output, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            sep, buffer->tid, buffer->tid);
+    sep = ",\n";
+    for (size_t e = buffer->count - n; e < buffer->count; ++e) {
+      const TraceEvent &event = buffer->events[e % TRACE_BUFFER_EVENTS];
+      fprintf(output, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              sep, event.name, buffer->tid, event.begin / 1.0e3, (event.end - event.begin) / 1.0e3);
+    }
+  }
+  fprintf(output, "\n]}\n");
+  fclose(output);
+  if (verbose >= 1) {
+    printf("Trace written to %s\n", trace_filename.c_str());
+    if (dropped > 0)
+      printf("Trace buffers overflowed, %zu of the oldest events were dropped\n", dropped);
+  }
+}
+
+// enables tracing, the trace is written when the program exits
+static void trace_start(const std::string &filename)
+{
+  trace_filename = filename;
+  trace_origin = TraceClock::now();
+  trace_enabled = true;
+  trace_buffer();  // the main thread is thread 0
+  atexit(trace_write);
+}
+
+#endif  // _TRACE_HPP